@@ -0,0 +1,197 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "control_protocol.h"
+
+#ifndef _WIN32
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <sys/un.h>
+#endif
+
+#ifndef _WIN32
+// Функция подключения к управляющему сокету мастера, возвращает -1 при ошибке
+int connect_control(const char* path) {
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "[ERROR] Слишком длинный путь сокета: " << path << std::endl;
+        return -1;
+    }
+    std::strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("[ERROR] socket");
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        perror("[ERROR] Не удалось подключиться к мастеру");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Функция отправки пачки и получения ответа; results получает значения после каждой команды
+bool send_batch(int fd, const std::vector<ControlCommand>& batch, std::vector<int64_t>& results) {
+    if (send(fd, batch.data(), batch.size() * sizeof(ControlCommand), MSG_NOSIGNAL) < 0) {
+        perror("[ERROR] send");
+        return false;
+    }
+    ControlReplyHeader header;
+    results.resize(batch.size());
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = results.data();
+    iov[1].iov_len = results.size() * sizeof(int64_t);
+    ssize_t n = readv(fd, iov, 2);
+    if (n < static_cast<ssize_t>(sizeof(header))) {
+        std::cerr << "[ERROR] Мастер закрыл соединение" << std::endl;
+        return false;
+    }
+    if (header.status != CTL_OK || header.count != batch.size()) {
+        std::cerr << "[ERROR] Мастер отклонил пачку, код " << header.status << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Функция времени в наносекундах для замеров
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Функция нагрузочного замера: для каждого размера пачки - команды в секунду и время ответа.
+// Пачка состоит из чередующихся +1 и -1, поэтому значение счётчика после замера не меняется
+int run_load(int fd, const std::vector<uint32_t>& sizes, double seconds) {
+    std::cout << "batch     requests/s     commands/s   rtt p50, us   rtt p99, us" << std::endl;
+    std::vector<int64_t> results;
+    for (uint32_t size : sizes) {
+        std::vector<ControlCommand> batch(size);
+        for (uint32_t i = 0; i < size; ++i) {
+            batch[i] = { CTL_ADD, 0, i % 2 == 0 ? 1 : -1 };
+        }
+        std::vector<int64_t> rtt;
+        int64_t start = now_ns();
+        int64_t until = start + static_cast<int64_t>(seconds * 1e9);
+        int64_t now = start;
+        while (now < until) {
+            // Пачка из одной команды тоже должна сходиться к нулю - меняем знак на каждом запросе
+            if (size % 2 == 1) {
+                batch[size - 1].arg = -batch[size - 1].arg;
+            }
+            int64_t sent = now;
+            if (!send_batch(fd, batch, results)) {
+                return 1;
+            }
+            now = now_ns();
+            rtt.push_back(now - sent);
+        }
+        std::sort(rtt.begin(), rtt.end());
+        double elapsed = (now - start) / 1e9;
+        char line[160];
+        snprintf(line, sizeof(line), "%5u %14.0f %14.0f %13.1f %13.1f", size, rtt.size() / elapsed,
+                 rtt.size() * static_cast<double>(size) / elapsed, rtt[rtt.size() / 2] / 1000.0,
+                 rtt[std::min(rtt.size() - 1, rtt.size() * 99 / 100)] / 1000.0);
+        std::cout << line << std::endl;
+    }
+    return 0;
+}
+#endif
+
+// Клиент управляющего сокета HW_3.
+//   control_client [--socket PATH] get | set N | add N | mul N | div N ...  - одна пачка команд
+//   control_client [--socket PATH] --load [--batches 1,16,256] [--seconds S] - нагрузочный замер
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    std::cerr << "[ERROR] Управляющий сокет поддерживается только на Linux." << std::endl;
+    return 1;
+#else
+    const char* path = getenv("HW3_CONTROL_SOCKET") ? getenv("HW3_CONTROL_SOCKET") : CONTROL_SOCKET_PATH;
+    bool load = false;
+    double seconds = 1.0;
+    std::vector<uint32_t> sizes = { 1, 4, 16, 64, 256, 1024, CONTROL_MAX_BATCH };
+    std::vector<ControlCommand> batch;
+    for (int i = 1; i < argc; ++i) {
+        ControlOp op;
+        if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--load") == 0) {
+            load = true;
+        }
+        else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = std::max(0.01, std::atof(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--batches") == 0 && i + 1 < argc) {
+            sizes.clear();
+            for (const char* p = argv[++i]; *p != '\0'; ) {
+                char* end = nullptr;
+                unsigned long size = std::strtoul(p, &end, 10);
+                if (end == p || size == 0 || size > CONTROL_MAX_BATCH) {
+                    std::cerr << "[ERROR] Размер пачки должен быть от 1 до " << CONTROL_MAX_BATCH << std::endl;
+                    return 1;
+                }
+                sizes.push_back(static_cast<uint32_t>(size));
+                p = *end == ',' ? end + 1 : end;
+            }
+        }
+        else if (parse_control_op(argv[i], op)) {
+            ControlCommand cmd = { op, 0, 0 };
+            if (op != CTL_GET) {
+                if (i + 1 >= argc) {
+                    std::cerr << "[ERROR] Команде " << argv[i] << " нужен аргумент" << std::endl;
+                    return 1;
+                }
+                cmd.arg = std::strtoll(argv[++i], nullptr, 10);
+            }
+            batch.push_back(cmd);
+        }
+        else {
+            std::cerr << "[ERROR] Неизвестный параметр: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (!load && batch.empty()) {
+        batch.push_back({ CTL_GET, 0, 0 });
+    }
+    if (batch.size() > CONTROL_MAX_BATCH) {
+        std::cerr << "[ERROR] Не больше " << CONTROL_MAX_BATCH << " команд в пачке" << std::endl;
+        return 1;
+    }
+
+    int fd = connect_control(path);
+    if (fd < 0) {
+        return 1;
+    }
+    int status = 0;
+    if (load) {
+        status = run_load(fd, sizes, seconds);
+    } else {
+        std::vector<int64_t> results;
+        if (send_batch(fd, batch, results)) {
+            for (int64_t value : results) {
+                std::cout << value << '\n';
+            }
+        } else {
+            status = 1;
+        }
+    }
+    close(fd);
+    return status;
+#endif
+}
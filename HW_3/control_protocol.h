@@ -0,0 +1,60 @@
+#ifndef HW3_CONTROL_PROTOCOL_H
+#define HW3_CONTROL_PROTOCOL_H
+
+// Управляющий сокет HW_3: общий формат для main.cpp и control_client.cpp.
+// Сокет SOCK_SEQPACKET, поэтому границы сообщений сохраняются: один пакет запроса -
+// одна пачка команд, один пакет ответа - результаты всех команд пачки
+
+#include <cstdint>
+#include <cstring>
+
+// Путь сокета по умолчанию (рядом с log.txt); переопределяется HW3_CONTROL_SOCKET
+const char CONTROL_SOCKET_PATH[] = "hw3.sock";
+
+// Наибольшее число команд в одной пачке
+const uint32_t CONTROL_MAX_BATCH = 4096;
+
+// Команды над счётчиком
+enum ControlOp : uint32_t {
+    CTL_GET = 0, // Результат - текущее значение
+    CTL_SET = 1,
+    CTL_ADD = 2,
+    CTL_MUL = 3,
+    CTL_DIV = 4  // Деление на 0 оставляет значение без изменений
+};
+
+// Команда пачки; результат каждой команды - значение счётчика после неё
+struct ControlCommand {
+    uint32_t op;       // ControlOp
+    uint32_t reserved; // 0
+    int64_t arg;
+};
+static_assert(sizeof(ControlCommand) == 16, "ControlCommand должна занимать 16 байт");
+
+// Коды ответа
+enum ControlStatus : int32_t {
+    CTL_OK = 0,
+    CTL_BAD_REQUEST = 1, // Пакет не кратен команде, пуст, слишком велик или команда неизвестна
+    CTL_FAILED = 2       // Не удалось захватить мьютекс счётчика
+};
+
+// Заголовок ответа, за ним следуют count значений int64_t (при CTL_OK - по одному на команду)
+struct ControlReplyHeader {
+    int32_t status; // ControlStatus
+    uint32_t count;
+};
+static_assert(sizeof(ControlReplyHeader) == 8, "ControlReplyHeader должен занимать 8 байт");
+
+// Функция разбора названия команды
+inline bool parse_control_op(const char* name, ControlOp& op) {
+    static const char* const names[] = { "get", "set", "add", "mul", "div" };
+    for (uint32_t i = 0; i <= CTL_DIV; ++i) {
+        if (std::strcmp(name, names[i]) == 0) {
+            op = static_cast<ControlOp>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef HW3_COUNTER_HISTORY_H
+#define HW3_COUNTER_HISTORY_H
+
+// История значений счётчика HW_3: общий формат для main.cpp и query_history.cpp.
+// Кольцо фиксированного размера в сегменте <SHM_NAME>_history; запись добавляется при каждой
+// публикации снимка счётчика. Записи упорядочены по позиции; по времени - с точностью до
+// гонки одновременных писателей (соседние записи могут разойтись на время одной публикации)
+
+#include <atomic>
+#include <cstdint>
+
+// Заголовок сегмента истории
+const char HISTORY_MAGIC[8] = { 'H', 'W', '3', 'H', 'I', 'S', 'T', '1' };
+
+// Число записей в кольце (степень двойки): 2 МиБ, при изменении раз в 300 мс - больше 5 часов
+const uint64_t HISTORY_CAPACITY = 1 << 16;
+
+// Операция, после которой записано значение (первые четыре совпадают с CounterOp)
+enum HistoryOp : uint32_t {
+    HOP_ADD = 0,
+    HOP_MUL = 1,
+    HOP_DIV = 2,
+    HOP_SET = 3,
+    HOP_TXN = 4,     // Транзакция режима optimistic
+    HOP_BATCH = 5,   // Пачка команд управляющего сокета
+    HOP_RECOVER = 6  // Значение восстановлено из файла сохранения
+};
+
+// Запись истории. seq - собственный seqlock записи: 2 * pos + 1 - запись идёт,
+// 2 * pos + 2 - запись позиции pos готова. Больше - позиция уже затёрта; меньше - позиция
+// ещё не записана или пропущена писателем (ячейку держал отставший на круг писатель)
+struct HistoryEntry {
+    std::atomic<uint64_t> seq;
+    std::atomic<int64_t> timeNs; // CLOCK_REALTIME, нс
+    std::atomic<int64_t> value;
+    std::atomic<int32_t> pid;
+    std::atomic<uint32_t> op;    // HistoryOp
+};
+static_assert(sizeof(HistoryEntry) == 32, "HistoryEntry должна занимать 32 байта");
+
+struct HistorySegment {
+    char magic[8];
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> head; // Позиция следующей записи
+    HistoryEntry entries[HISTORY_CAPACITY];
+};
+
+// Копия записи для читателя
+struct HistoryRecord {
+    int64_t timeNs;
+    int64_t value;
+    int32_t pid;
+    uint32_t op;
+};
+
+// Функция добавления записи без блокировок: позицию даёт fetch_add, ячейку занимает CAS seq
+// с чётного значения меньшей позиции. Если в ячейке ещё пишет писатель, отставший на круг,
+// или её уже заняла позиция новее, берём следующую позицию: иначе поля двух записей смешались бы
+inline void history_append(HistorySegment* history, int64_t timeNs, int64_t value, int32_t pid, uint32_t op) {
+    uint64_t pos;
+    HistoryEntry* claimed = nullptr;
+    while (claimed == nullptr) {
+        pos = history->head.fetch_add(1, std::memory_order_relaxed);
+        HistoryEntry& entry = history->entries[pos & (HISTORY_CAPACITY - 1)];
+        uint64_t current = entry.seq.load(std::memory_order_relaxed);
+        if ((current & 1) == 0 && current < 2 * pos + 1
+            && entry.seq.compare_exchange_strong(current, 2 * pos + 1, std::memory_order_relaxed)) {
+            claimed = &entry;
+        }
+    }
+    HistoryEntry& entry = *claimed;
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.timeNs.store(timeNs, std::memory_order_relaxed);
+    entry.value.store(value, std::memory_order_relaxed);
+    entry.pid.store(pid, std::memory_order_relaxed);
+    entry.op.store(op, std::memory_order_relaxed);
+    entry.seq.store(2 * pos + 2, std::memory_order_release);
+}
+
+// Функция чтения записи позиции pos; false - запись ещё не готова или уже затёрта
+inline bool history_read(const HistorySegment* history, uint64_t pos, HistoryRecord& out) {
+    const HistoryEntry& entry = history->entries[pos & (HISTORY_CAPACITY - 1)];
+    uint64_t before = entry.seq.load(std::memory_order_acquire);
+    if (before != 2 * pos + 2) {
+        return false;
+    }
+    out.timeNs = entry.timeNs.load(std::memory_order_relaxed);
+    out.value = entry.value.load(std::memory_order_relaxed);
+    out.pid = entry.pid.load(std::memory_order_relaxed);
+    out.op = entry.op.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry.seq.load(std::memory_order_relaxed) == before;
+}
+
+// Функция получения названия операции
+inline const char* history_op_name(uint32_t op) {
+    static const char* const names[] = { "add", "mul", "div", "set", "txn", "batch", "recover" };
+    return op <= HOP_RECOVER ? names[op] : "?";
+}
+
+#endif
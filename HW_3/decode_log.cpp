@@ -0,0 +1,31 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "event_log.h"
+
+// Перевод бинарного журнала log.bin в текст того же вида, что и log.txt
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "log.bin";
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "[ERROR] Не удалось открыть " << path << std::endl;
+        return 1;
+    }
+
+    char magic[sizeof(EVENT_LOG_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)) != 0) {
+        std::cerr << "[ERROR] " << path << " не является журналом событий HW_3" << std::endl;
+        return 1;
+    }
+
+    EventRecord ev;
+    while (in.read(reinterpret_cast<char*>(&ev), sizeof(ev))) {
+        std::cout << format_event(ev) << '\n';
+    }
+    if (in.gcount() != 0) {
+        std::cerr << "[ERROR] Журнал обрывается на неполной записи" << std::endl;
+        return 1;
+    }
+    return 0;
+}
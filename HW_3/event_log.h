@@ -0,0 +1,193 @@
+#ifndef HW3_EVENT_LOG_H
+#define HW3_EVENT_LOG_H
+
+// Бинарный журнал событий HW_3: общий формат для main.cpp и decode_log.cpp
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+// Заголовок файла log.bin
+const char EVENT_LOG_MAGIC[8] = { 'H', 'W', '3', 'E', 'V', 'T', '1', '\0' };
+
+// Виды событий; у каждого своя строка текстового формата в format_event
+enum EventKind : uint16_t {
+    EV_MAIN_START = 1,          // value: 1 - мастер, 0 - слейв
+    EV_COPY1_START = 2,
+    EV_COPY1_END = 3,           // value: счётчик
+    EV_COPY2_START = 4,
+    EV_COPY2_END = 5,           // value: счётчик
+    EV_DEBUG_TICK = 6,          // value: счётчик после +1
+    EV_MASTER_REPORT = 7,       // value: счётчик, aux: PID последнего писателя
+    EV_MASTER_SPAWNED = 8,
+    EV_MASTER_SPAWN_FAILED = 9,
+    EV_MASTER_SPAWN_SKIPPED = 10,
+    EV_MASTER_POOL_QUEUED = 11,
+    EV_MASTER_POOL_FULL = 12,
+    EV_MASTER_WORKER_RESTARTED = 13, // value: PID завершившегося воркера, aux: PID нового
+    EV_USER_SET = 14,           // value: новое значение
+    EV_STATS = 15,              // value: число пробуждений, aux: время работы цикла, нс
+    EV_MASTER_COPY_EXITED = 16, // value: PID (TID у копии-потока) копии, aux: время работы, мкс, code: см. copy_exit_code
+    EV_MASTER_STALENESS = 17,   // value: порог sloppy в прибавлениях, aux: порог в мс (0 - нет)
+    EV_MASTER_TAKEOVER = 18,    // value: PID прежнего мастера, aux: время без продления аренды, мкс
+    EV_MASTER_DEMOTED = 19      // value: PID мастера, перехватившего аренду
+};
+
+// Функция упаковки завершения копии в поле code: режим, признак сигнала, признак копии-потока
+// (тогда value - TID, а не PID) и код/номер сигнала
+inline uint16_t copy_exit_code(int mode, bool signaled, int number, bool thread = false) {
+    return static_cast<uint16_t>((mode & 0xF) << 12 | (thread ? 0x200 : 0) | (signaled ? 0x100 : 0) | (number & 0xFF));
+}
+
+// Запись журнала фиксированного размера: без форматирования на горячем пути
+struct EventRecord {
+    int64_t timeNs;  // CLOCK_REALTIME, нс
+    int32_t pid;
+    uint16_t kind;   // EventKind
+    uint16_t code;   // Дополнительный код события, 0 - нет
+    int64_t value;
+    int64_t aux;
+};
+static_assert(sizeof(EventRecord) == 32, "EventRecord должен занимать 32 байта");
+
+// Метка времени "YYYY-MM-DD HH:MM:SS.mmm": длина префикса до секунд и размер буфера с нулём
+const size_t TIME_PREFIX_LEN = 19;
+const size_t TIME_TEXT_SIZE = 24;
+
+// Функция записи value ровно width десятичными цифрами, возвращает позицию за ними
+inline char* put_digits(char* out, int value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+// Функция форматирования префикса "YYYY-MM-DD HH:MM:SS" для секунды эпохи (буфер - TIME_TEXT_SIZE)
+inline void format_time_prefix(int64_t second, char* out) {
+    time_t seconds = static_cast<time_t>(second);
+    struct tm tm_now;
+#ifdef _WIN32
+    localtime_s(&tm_now, &seconds);
+#else
+    localtime_r(&seconds, &tm_now);
+#endif
+    char* p = put_digits(out, tm_now.tm_year + 1900, 4);
+    *p++ = '-';
+    p = put_digits(p, tm_now.tm_mon + 1, 2);
+    *p++ = '-';
+    p = put_digits(p, tm_now.tm_mday, 2);
+    *p++ = ' ';
+    p = put_digits(p, tm_now.tm_hour, 2);
+    *p++ = ':';
+    p = put_digits(p, tm_now.tm_min, 2);
+    *p++ = ':';
+    p = put_digits(p, tm_now.tm_sec, 2);
+    *p = '\0';
+}
+
+// Функция дописывания ".mmm" за префиксом
+inline void format_time_millis(int64_t timeNs, char* out) {
+    out[0] = '.';
+    put_digits(out + 1, static_cast<int>((timeNs % 1000000000) / 1000000), 3);
+    out[4] = '\0';
+}
+
+// Функция форматирования времени в наносекундах как "YYYY-MM-DD HH:MM:SS.mmm" в буфер
+// вызывающего (не меньше TIME_TEXT_SIZE байт), без выделения памяти
+inline const char* format_time_ns(int64_t timeNs, char* buf) {
+    format_time_prefix(timeNs / 1000000000, buf);
+    format_time_millis(timeNs, buf + TIME_PREFIX_LEN);
+    return buf;
+}
+
+// Функция форматирования времени в наносекундах как "YYYY-MM-DD HH:MM:SS.mmm"
+inline std::string format_time_ns(int64_t timeNs) {
+    char buffer[TIME_TEXT_SIZE];
+    return std::string(format_time_ns(timeNs, buffer));
+}
+
+// Форматирование метки времени для format_event: main.cpp подставляет кэш префикса
+// в разделяемой памяти, decode_log - обычное форматирование
+typedef const char* (*TimeFormatter)(int64_t timeNs, char* buf);
+
+// Функция получения текстовой строки события в формате log.txt
+inline std::string format_event(const EventRecord& ev, TimeFormatter formatTime = format_time_ns) {
+    std::string pid = std::to_string(ev.pid);
+    std::string value = std::to_string(ev.value);
+    char time[TIME_TEXT_SIZE];
+    switch (ev.kind) {
+    case EV_MAIN_START:
+        return "[MAIN] Start: PID=" + pid + ", time=" + formatTime(ev.timeNs, time)
+             + (ev.value ? " (MASTER)" : " (SLAVE)");
+    case EV_COPY1_START:
+        return "[COPY1] Start: PID=" + pid + ", time=" + formatTime(ev.timeNs, time);
+    case EV_COPY1_END:
+        return "[COPY1] End: PID=" + pid + ", time=" + formatTime(ev.timeNs, time) + ", counter=" + value;
+    case EV_COPY2_START:
+        return "[COPY2] Start: PID=" + pid + ", time=" + formatTime(ev.timeNs, time);
+    case EV_COPY2_END:
+        return "[COPY2] End: PID=" + pid + ", time=" + formatTime(ev.timeNs, time) + ", counter=" + value;
+    case EV_DEBUG_TICK:
+        return "[DEBUG] PID=" + pid + " увеличил счётчик до " + value;
+    case EV_MASTER_REPORT:
+        return std::string("[MASTER] ") + formatTime(ev.timeNs, time) + " PID=" + pid + ", counter=" + value
+             + ", writer=" + std::to_string(ev.aux);
+    case EV_MASTER_SPAWNED:
+        return "[MASTER] Запущены копии 1 и 2.";
+    case EV_MASTER_SPAWN_FAILED:
+        return "[MASTER] Не удалось запустить копии.";
+    case EV_MASTER_SPAWN_SKIPPED:
+        return std::string("[MASTER] ") + formatTime(ev.timeNs, time)
+             + " Некоторые копии ещё работают. Пропуск запуска новых копий.";
+    case EV_MASTER_POOL_QUEUED:
+        return "[MASTER] Задания 1 и 2 переданы пулу воркеров.";
+    case EV_MASTER_POOL_FULL:
+        return "[MASTER] Очередь заданий переполнена, часть заданий пропущена.";
+    case EV_MASTER_WORKER_RESTARTED:
+        return "[MASTER] Воркер PID=" + value + " завершился, запущен новый PID=" + std::to_string(ev.aux);
+    case EV_USER_SET:
+        return "[USER] Установлено новое значение счётчика: " + value
+             + " | PID=" + pid + " | time=" + formatTime(ev.timeNs, time);
+    case EV_MASTER_COPY_EXITED: {
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), "[MASTER] Копия %d %s=%lld завершилась: %s %d, время работы %.1f мс",
+                 ev.code >> 12, (ev.code & 0x200) ? "TID" : "PID", static_cast<long long>(ev.value),
+                 (ev.code & 0x100) ? "сигнал" : "код",
+                 ev.code & 0xFF, ev.aux / 1000.0);
+        return std::string(buffer);
+    }
+    case EV_MASTER_STALENESS: {
+        // Каждый процесс держит у себя меньше порога прибавлений - на столько отчёт и отстаёт
+        std::string bound;
+        if (ev.value > 1) {
+            bound = "до " + std::to_string(ev.value - 1) + " прибавлений";
+        }
+        if (ev.aux > 0) {
+            bound += (bound.empty() ? "" : " или ") + std::string("прибавления за ") + std::to_string(ev.aux) + " мс";
+        }
+        return "[MASTER] Счётчик может не учитывать " + bound + " каждого процесса (режим sloppy)";
+    }
+    case EV_MASTER_TAKEOVER: {
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), "[MASTER] PID=%d перехватил роль мастера у PID=%lld: аренда не продлевалась %.1f мс",
+                 ev.pid, static_cast<long long>(ev.value), ev.aux / 1000.0);
+        return std::string(buffer);
+    }
+    case EV_MASTER_DEMOTED:
+        return "[MASTER] PID=" + pid + " потерял аренду роли мастера, мастер теперь PID=" + value;
+    case EV_STATS: {
+        double seconds = ev.aux / 1e9;
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), "[STATS] PID=%d wakeups=%lld за %.1f с (%.2f в секунду)",
+                 ev.pid, static_cast<long long>(ev.value), seconds,
+                 seconds > 0 ? ev.value / seconds : 0.0);
+        return std::string(buffer);
+    }
+    }
+    return "[UNKNOWN] kind=" + std::to_string(ev.kind) + " PID=" + pid;
+}
+
+#endif
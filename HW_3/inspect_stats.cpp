@@ -0,0 +1,149 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+
+#include "event_log.h"
+#include "latency_stats.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifndef _WIN32
+// Функция отображения сегмента статистики только для чтения
+const StatsSegment* map_stats_segment(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        perror(("[ERROR] shm_open " + name).c_str());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(StatsSegment)) {
+        std::cerr << "[ERROR] " << name << " не является сегментом статистики HW_3" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    void* addr = mmap(NULL, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        return nullptr;
+    }
+    const StatsSegment* segment = static_cast<const StatsSegment*>(addr);
+    if (std::memcmp(segment->magic, STATS_MAGIC, sizeof(STATS_MAGIC)) != 0
+        || segment->slotCount != STATS_SLOTS || segment->bucketCount != HIST_BUCKETS) {
+        std::cerr << "[ERROR] Формат " << name << " не совпадает с этой сборкой" << std::endl;
+        munmap(addr, sizeof(StatsSegment));
+        return nullptr;
+    }
+    return segment;
+}
+
+// Функция печати строки перцентилей гистограммы, в микросекундах
+void print_row(const char* pid, const char* role, const char* state, int kind, const LatencyHistogram& hist) {
+    char line[200];
+    snprintf(line, sizeof(line), "%-8s %-7s %-7s %-10s %10llu %9.1f %9.1f %9.1f %9.1f",
+             pid, role, state, STAT_NAMES[kind], static_cast<unsigned long long>(hist.total),
+             histogram_percentile(hist, 50) / 1000.0, histogram_percentile(hist, 99) / 1000.0,
+             histogram_percentile(hist, 99.9) / 1000.0, histogram_percentile(hist, 100) / 1000.0);
+    std::cout << line << '\n';
+}
+
+// Функция печати статистики всех слотов и суммы по всем процессам
+void print_stats(const StatsSegment* segment) {
+    static LatencyHistogram total[STAT_KIND_COUNT];
+    static LatencyHistogram hist;
+    std::memset(total, 0, sizeof(total));
+    for (int kind = 0; kind < STAT_KIND_COUNT; ++kind) {
+        histogram_merge(total[kind], segment->retired[kind]);
+    }
+
+    std::cout << "=== " << format_time_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch()).count()) << " (мкс) ===\n";
+    std::cout << "PID      role    state   op              count       p50       p99     p99.9       max\n";
+    for (const StatsSlot& slot : segment->slots) {
+        int32_t pid = slot.pid.load(std::memory_order_acquire);
+        if (pid == 0) {
+            continue;
+        }
+        const char* state = "live";
+        if (pid < 0) {
+            state = "exited";
+            pid = -pid;
+        } else if (kill(pid, 0) == -1 && errno == ESRCH) {
+            state = "dead"; // Процесс не успел освободить слот
+        }
+        char role[sizeof(slot.role) + 1] = {};
+        std::memcpy(role, slot.role, sizeof(slot.role));
+        std::string pidText = std::to_string(pid);
+        for (int kind = 0; kind < STAT_KIND_COUNT; ++kind) {
+            std::memset(&hist, 0, sizeof(hist));
+            histogram_merge(hist, slot.hist[kind]);
+            histogram_merge(total[kind], hist);
+            if (hist.total > 0) {
+                print_row(pidText.c_str(), role, state, kind, hist);
+            }
+        }
+    }
+    for (int kind = 0; kind < STAT_KIND_COUNT; ++kind) {
+        if (total[kind].total > 0) {
+            print_row("all", "", "", kind, total[kind]);
+        }
+    }
+    std::cout << std::endl;
+}
+#endif
+
+// Инспектор гистограмм задержек HW_3: отображает сегмент <SHM_NAME>_stats только для чтения
+// и печатает перцентили по процессам и в сумме.
+//   inspect_stats [--shm NAME] [--interval MS] [--once]
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    std::cerr << "[ERROR] Инспектор поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    std::string shmName = getenv("HW3_SHM_NAME") ? getenv("HW3_SHM_NAME") : "/mysharedmemory";
+    int intervalMs = 1000;
+    bool once = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shmName = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            intervalMs = std::max(10, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--once") == 0) {
+            once = true;
+        }
+        else {
+            std::cerr << "[ERROR] Неизвестный параметр: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    const StatsSegment* segment = map_stats_segment(shmName + "_stats");
+    if (segment == nullptr) {
+        return 1;
+    }
+    while (true) {
+        print_stats(segment);
+        if (once) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+    munmap(const_cast<StatsSegment*>(segment), sizeof(StatsSegment));
+    return 0;
+#endif
+}
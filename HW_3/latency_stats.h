@@ -0,0 +1,146 @@
+#ifndef HW3_LATENCY_STATS_H
+#define HW3_LATENCY_STATS_H
+
+// Гистограммы задержек HW_3: общий формат для main.cpp и inspect_stats.cpp.
+// Каждый процесс пишет в свой слот отдельного сегмента <SHM_NAME>_stats, инспектор
+// отображает сегмент только для чтения и ничего в нём не меняет
+
+#include <atomic>
+#include <cstdint>
+
+// Гистограмма задержек с логарифмическими корзинами (как в HDR Histogram):
+// 8 подкорзин на каждую степень двойки, относительная погрешность не больше 12.5%
+const int HIST_SUB_BITS = 3;
+const int HIST_BUCKETS = 64 << HIST_SUB_BITS;
+
+struct LatencyHistogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+};
+
+// Функция получения номера старшего единичного бита
+inline int highest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Функция получения корзины для значения в наносекундах
+inline int histogram_bucket(uint64_t ns) {
+    if (ns < (1u << HIST_SUB_BITS)) {
+        return static_cast<int>(ns);
+    }
+    int shift = highest_bit(ns) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + static_cast<int>((ns >> shift) & ((1u << HIST_SUB_BITS) - 1));
+}
+
+// Функция получения середины корзины в наносекундах
+inline uint64_t histogram_bucket_value(int bucket) {
+    if (bucket < (1 << HIST_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    uint64_t mantissa = (1u << HIST_SUB_BITS) + (bucket & ((1 << HIST_SUB_BITS) - 1));
+    return (mantissa << shift) + ((1ull << shift) >> 1);
+}
+
+// Функция добавления значения в гистограмму
+inline void histogram_record(LatencyHistogram& hist, int64_t ns) {
+    hist.counts[histogram_bucket(ns > 0 ? static_cast<uint64_t>(ns) : 0)]++;
+    hist.total++;
+}
+
+// Функция объединения гистограмм
+inline void histogram_merge(LatencyHistogram& into, const LatencyHistogram& from) {
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        into.counts[i] += from.counts[i];
+    }
+    into.total += from.total;
+}
+
+// Функция получения перцентиля (0..100) в наносекундах; 100 - наибольшее значение
+inline uint64_t histogram_percentile(const LatencyHistogram& hist, double percentile) {
+    if (hist.total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * hist.total);
+    if (rank >= hist.total) {
+        rank = hist.total - 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += hist.counts[i];
+        if (seen > rank) {
+            return histogram_bucket_value(i);
+        }
+    }
+    return histogram_bucket_value(HIST_BUCKETS - 1);
+}
+
+// Та же гистограмма в разделяемой памяти: пишут потоки процесса-владельца, читает инспектор
+struct SharedHistogram {
+    std::atomic<uint64_t> counts[HIST_BUCKETS];
+    std::atomic<uint64_t> total;
+};
+
+// Функция добавления значения в разделяемую гистограмму (слот чужие процессы не пишут,
+// поэтому кэш-линии не перебрасываются между ядрами)
+inline void histogram_record(SharedHistogram& hist, int64_t ns) {
+    hist.counts[histogram_bucket(ns > 0 ? static_cast<uint64_t>(ns) : 0)].fetch_add(1, std::memory_order_relaxed);
+    hist.total.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Функция добавления разделяемой гистограммы к обычной. Снимок не атомарен:
+// во время записи total может на единицу расходиться с суммой корзин
+inline void histogram_merge(LatencyHistogram& into, const SharedHistogram& from) {
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        uint64_t count = from.counts[i].load(std::memory_order_relaxed);
+        into.counts[i] += count;
+        total += count;
+    }
+    into.total += total;
+}
+
+// Замеряемые операции
+enum StatKind : int {
+    STAT_LOCK_WAIT = 0, // Ожидание мьютекса счётчика
+    STAT_LOCK_HOLD = 1, // Удержание мьютекса счётчика
+    STAT_LOG_WRITE = 2, // Запись в лог-файл (writev пачки или прямая запись)
+    STAT_SPAWN = 3,     // Порождение копии или воркера (fork до возврата в родителе)
+    STAT_KIND_COUNT = 4
+};
+
+const char* const STAT_NAMES[STAT_KIND_COUNT] = { "lock wait", "lock hold", "log write", "spawn" };
+
+// Заголовок сегмента статистики
+const char STATS_MAGIC[8] = { 'H', 'W', '3', 'S', 'T', 'A', 'T', '1' };
+
+// Число слотов: при нехватке занимаются слоты завершившихся процессов
+const int STATS_SLOTS = 64;
+
+// Слот процесса. pid > 0 - процесс работает, pid < 0 - процесс -pid завершился
+// (данные остаются видны инспектору), 0 - слот не занят ни разу
+struct alignas(64) StatsSlot {
+    std::atomic<int32_t> pid;
+    char role[12];      // master, slave, copy1, copy2, worker, ...
+    int64_t startNs;    // CLOCK_REALTIME запуска процесса
+    SharedHistogram hist[STAT_KIND_COUNT];
+};
+
+struct StatsSegment {
+    char magic[8];
+    uint32_t slotCount;
+    uint32_t bucketCount;
+    // Гистограммы процессов, чьи слоты заняты заново
+    SharedHistogram retired[STAT_KIND_COUNT];
+    StatsSlot slots[STATS_SLOTS];
+};
+
+#endif
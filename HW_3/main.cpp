@@ -1,3 +1,6 @@
+// Сборка (Linux): g++ -std=c++17 -O2 -pthread main.cpp -o main -lz
+// Без zlib: g++ -std=c++17 -O2 -pthread -DHW3_NO_ZLIB main.cpp -o main - сегменты лога не сжимаются
+
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -6,9 +9,23 @@
 #include <chrono>
 #include <atomic>
 #include <mutex>
+#include <functional>
+#include <algorithm>
 #include <cstring>
 #include <ctime>
 #include <cstdlib>
+#include <cstdint>
+#include <limits>
+#include <cctype>
+#include <deque>
+#include <condition_variable>
+#include <memory>
+#include <system_error>
+
+#include "event_log.h"
+#include "control_protocol.h"
+#include "latency_stats.h"
+#include "counter_history.h"
 
 #ifdef _WIN32
     #include <windows.h>
@@ -21,16 +38,408 @@
     #include <sys/types.h>
     #include <sys/wait.h>
     #include <sys/stat.h>
-    #include <mach-o/dyld.h> // Для macOS получения пути к исполняемому файлу
+    #include <sys/uio.h>
+    #include <sys/resource.h>
+    #include <dirent.h>
+    #ifndef HW3_NO_ZLIB
+        #include <zlib.h>
+    #endif
+    #include <climits>
+    #include <signal.h>
+    #ifdef __linux__
+        #include <linux/futex.h>
+        #include <sys/syscall.h>
+        #include <sys/prctl.h>
+        #include <sys/epoll.h>
+        #include <poll.h>
+        #include <sys/timerfd.h>
+        #include <sys/signalfd.h>
+        #include <sys/eventfd.h>
+        #include <sys/socket.h>
+        #include <sys/un.h>
+        #include <mqueue.h>
+    #endif
+    #ifdef __APPLE__
+        #include <mach-o/dyld.h> // Для macOS получения пути к исполняемому файлу
+    #endif
+#endif
+
+// Способы синхронизации изменений счётчика
+enum CounterBackend : int {
+    BACKEND_MUTEX = 0,  // Каждая операция под межпроцессным мьютексом
+    BACKEND_ATOMIC = 1, // Lock-free: fetch_add и CAS-циклы над std::atomic
+    BACKEND_SHARDED = 2, // Слот на процесс для прибавлений, чтение суммирует слоты
+    BACKEND_FUTEX = 3,  // Как mutex, но на своей блокировке: спин, затем futex (Linux)
+    BACKEND_OPTIMISTIC = 4 // Транзакции: вычисление без блокировки, фиксация CAS значения
+};
+
+// Уровни важности записей лога
+enum LogLevel : int {
+    LEVEL_DEBUG = 0, // Трассировка каждого изменения счётчика
+    LEVEL_INFO = 1,
+    LEVEL_WARN = 2,
+    LEVEL_ERROR = 3
+};
+
+// Уровень, ниже которого записи не попадают в сборку вовсе (вместе с формированием строк).
+// Сборка без отладочной трассировки: -DHW3_LOG_LEVEL=1
+#ifndef HW3_LOG_LEVEL
+#define HW3_LOG_LEVEL 0
+#endif
+
+// Операции над счётчиком
+enum CounterOp : int {
+    OP_ADD = 0,
+    OP_MUL = 1,
+    OP_DIV = 2,
+    OP_SET = 3
+};
+
+// Атомик лежит в разделяемой памяти, поэтому должен быть lock-free (address-free)
+static_assert(std::atomic<int64_t>::is_always_lock_free, "std::atomic<int64_t> должен быть lock-free");
+
+// Ограниченная кольцевая очередь в разделяемой памяти (схема Вьюкова). seq ячейки
+// говорит, чья очередь с ней работать: == позиция - ячейка свободна для записи,
+// == позиция + 1 - в ячейке готовый элемент. owner - PID писателя, занявшего ячейку:
+// если он завершился, не опубликовав её, читатель пропускает ячейку, а не ждёт вечно
+template <typename T>
+struct RingCell {
+    std::atomic<uint64_t> seq;
+    std::atomic<int32_t> owner; // 0 - ячейку никто не занимает
+    T item;
+};
+
+int cached_process_id();
+
+// Функция проверки, что писатель, занявший ячейку кольца, завершился
+inline bool ring_owner_dead(int32_t owner) {
+#ifdef _WIN32
+    (void)owner;
+    return false;
+#else
+    return owner > 0 && kill(owner, 0) == -1 && errno == ESRCH;
+#endif
+}
+
+template <typename T, uint64_t Capacity>
+struct SharedRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Ёмкость кольца должна быть степенью двойки");
+    alignas(64) std::atomic<uint64_t> head; // Следующая позиция для записи
+    alignas(64) std::atomic<uint64_t> tail; // Следующая позиция для чтения
+    RingCell<T> cells[Capacity];
+};
+
+// Функция подготовки кольца к первому кругу (вызывает мастер)
+template <typename T, uint64_t Capacity>
+void ring_init(SharedRing<T, Capacity>& ring) {
+    for (uint64_t i = 0; i < Capacity; ++i) {
+        ring.cells[i].seq.store(i, std::memory_order_relaxed);
+        ring.cells[i].owner.store(0, std::memory_order_relaxed);
+    }
+    ring.head.store(0, std::memory_order_relaxed);
+    ring.tail.store(0, std::memory_order_relaxed);
+}
+
+// Функция резервирования ячейки писателем без блокировок, nullptr - кольцо заполнено.
+// PID ставится в ячейку до сдвига head, поэтому у каждой занятой ячейки владелец известен
+template <typename T, uint64_t Capacity>
+RingCell<T>* ring_reserve(SharedRing<T, Capacity>& ring, uint64_t& pos) {
+    int32_t self = cached_process_id();
+    int spins = 0;
+    pos = ring.head.load(std::memory_order_relaxed);
+    while (true) {
+        RingCell<T>* cell = &ring.cells[pos & (Capacity - 1)];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            int32_t owner = cell->owner.load(std::memory_order_relaxed);
+            if (owner != 0 && (++spins < 1000 || !ring_owner_dead(owner))) {
+                // Ячейку прямо сейчас занимает другой писатель; если он завершился, не
+                // сдвинув head, метку забираем
+                pos = ring.head.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (!cell->owner.compare_exchange_strong(owner, self, std::memory_order_relaxed)) {
+                continue;
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst); // Метка - до сдвига head
+            if (ring.head.compare_exchange_strong(pos, pos + 1, std::memory_order_relaxed)) {
+                return cell;
+            }
+            cell->owner.store(0, std::memory_order_relaxed);
+        } else if (diff < 0) {
+            return nullptr;
+        } else {
+            pos = ring.head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Функция публикации заполненной ячейки для читателей
+template <typename T>
+void ring_publish(RingCell<T>* cell, uint64_t pos) {
+    cell->owner.store(0, std::memory_order_relaxed);
+    cell->seq.store(pos + 1, std::memory_order_release);
+}
+
+// Функция проверки ячейки на позиции pos, которую читатель ждёт: возвращает PID писателя,
+// который занял её и завершился, не опубликовав (0 - ячейку ещё есть смысл ждать)
+template <typename T, uint64_t Capacity>
+int32_t ring_abandoned(SharedRing<T, Capacity>& ring, uint64_t pos) {
+    RingCell<T>* cell = &ring.cells[pos & (Capacity - 1)];
+    if (cell->seq.load(std::memory_order_acquire) != pos || ring.head.load(std::memory_order_acquire) <= pos) {
+        return 0; // Ячейка готова или ещё никем не занята
+    }
+    int32_t owner = cell->owner.load(std::memory_order_relaxed);
+    return ring_owner_dead(owner) ? owner : 0;
+}
+
+// Функция постановки элемента целиком
+template <typename T, uint64_t Capacity>
+bool ring_push(SharedRing<T, Capacity>& ring, const T& item) {
+    uint64_t pos;
+    RingCell<T>* cell = ring_reserve(ring, pos);
+    if (cell == nullptr) {
+        return false;
+    }
+    cell->item = item;
+    ring_publish(cell, pos);
+    return true;
+}
+
+// Функция извлечения элемента, когда читателей несколько
+template <typename T, uint64_t Capacity>
+bool ring_pop(SharedRing<T, Capacity>& ring, T& out) {
+    uint64_t pos = ring.tail.load(std::memory_order_relaxed);
+    while (true) {
+        RingCell<T>* cell = &ring.cells[pos & (Capacity - 1)];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - (pos + 1));
+        if (diff == 0) {
+            if (ring.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                out = cell->item;
+                cell->seq.store(pos + Capacity, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            int32_t owner = ring_abandoned(ring, pos);
+            if (owner == 0) {
+                return false; // Кольцо пусто или писатель ещё заполняет ячейку
+            }
+            if (ring.tail.compare_exchange_strong(pos, pos + 1, std::memory_order_relaxed)) {
+                std::cerr << "[WARN] Пропущен элемент очереди: процесс " << owner
+                          << " завершился, не дописав его." << std::endl;
+                cell->owner.store(0, std::memory_order_relaxed);
+                cell->seq.store(pos + Capacity, std::memory_order_release);
+                pos = pos + 1;
+            }
+        } else {
+            pos = ring.tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Функция получения готовой ячейки для единственного читателя (без продвижения tail)
+template <typename T, uint64_t Capacity>
+RingCell<T>* ring_peek(SharedRing<T, Capacity>& ring, uint64_t pos) {
+    RingCell<T>* cell = &ring.cells[pos & (Capacity - 1)];
+    return cell->seq.load(std::memory_order_acquire) == pos + 1 ? cell : nullptr;
+}
+
+// Функция освобождения прочитанных единственным читателем ячеек [tail, tail + count)
+template <typename T, uint64_t Capacity>
+void ring_consume(SharedRing<T, Capacity>& ring, uint64_t count) {
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    for (uint64_t i = 0; i < count; ++i) {
+        ring.cells[(tail + i) & (Capacity - 1)].seq.store(tail + i + Capacity, std::memory_order_release);
+    }
+    ring.tail.store(tail + count, std::memory_order_relaxed);
+}
+
+#ifndef _WIN32
+// Параметры кольцевого буфера лог-записей
+const uint64_t LOG_RING_CAPACITY = 1024;
+const uint64_t EVENT_RING_CAPACITY = 4096;
+const size_t LOG_RECORD_TEXT = 244;
+
+// Текстовая лог-запись фиксированного размера
+struct LogLine {
+    uint32_t len;              // Длина текста вместе с '\n'
+    char text[LOG_RECORD_TEXT];
+};
+
+// Лог-записи всех процессов: писатели резервируют ячейки без блокировок, мастер вычитывает
+struct LogRing {
+    SharedRing<LogLine, LOG_RING_CAPACITY> lines;       // Для log.txt
+    SharedRing<EventRecord, EVENT_RING_CAPACITY> events; // Для log.bin
+    std::atomic<uint64_t> overflows;                     // Сколько записей ушло мимо колец
+    std::atomic<uint32_t> pushes;                        // futex-слово: растёт, когда будят поток мастера (Linux)
+    std::atomic<uint32_t> drainerSleeping;               // 1 - поток мастера ждёт на pushes
+};
 #endif
 
+#ifdef __linux__
+// Параметры очереди заданий для пула воркеров
+const uint64_t JOB_QUEUE_CAPACITY = 1024;
+
+// Задание для воркера: то же, что делает копия 1 или 2
+struct Job {
+    int mode;                  // Режим копии: 1 или 2
+    int holdMs;                // Пауза копии 2 между *2 и /2
+    int64_t submitNs;          // Время постановки (monotonic_ns)
+};
+
+// Статистика выполнения заданий одного режима
+struct JobStats {
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> dispatchSumNs; // От постановки до начала выполнения
+    std::atomic<uint64_t> dispatchMaxNs;
+    std::atomic<uint64_t> totalSumNs;    // От постановки до завершения
+};
+
+// Очередь заданий: мастер ставит, воркеры разбирают; спящие воркеры ждут на futexWord
+struct JobQueue {
+    SharedRing<Job, JOB_QUEUE_CAPACITY> jobs;
+    alignas(64) std::atomic<uint32_t> futexWord; // Увеличивается при каждой постановке
+    std::atomic<uint32_t> sleepers;              // Сколько воркеров спит на futexWord
+    std::atomic<uint32_t> shutdown;
+    JobStats stats[3];                           // Индекс - режим копии
+};
+#endif
+
+// Число слотов для режима sharded: каждый процесс занимает свой слот
+const int MAX_COUNTER_SLOTS = 128;
+
+// Слот процесса на отдельной кэш-линии: прибавления не гоняют общую линию между ядрами
+struct alignas(64) CounterSlot {
+    std::atomic<int64_t> delta;    // Накопленные прибавления (остаются и после выхода владельца)
+    std::atomic<int32_t> ownerPid; // 0 - слот свободен
+};
+
+// Число ячеек кольца снимков (степень двойки). Писатель, умерший посреди записи, портит
+// только свою ячейку: читатели берут предыдущую, остальные писатели его не ждут
+const uint64_t SNAPSHOT_SLOTS = 16;
+
+// Ячейка снимка со своим seqlock: 2 * ticket + 1 - запись идёт, 2 * ticket + 2 - готова
+struct SnapshotEntry {
+    std::atomic<uint64_t> seq;
+    std::atomic<int64_t> value;
+    std::atomic<int32_t> writerPid;  // Кто изменил счётчик
+    std::atomic<int64_t> updateNs;   // Когда (CLOCK_REALTIME, нс)
+};
+
+// Снимки счётчика без блокировок: писатель берёт номер fetch_add и занимает ячейку CAS,
+// читатель берёт самую свежую готовую. Последний по номеру писатель побеждает
+struct alignas(64) CounterSeqlock {
+    std::atomic<uint32_t> seq;       // Растёт на 2 после каждой публикации: futex-слово подписчиков
+    std::atomic<uint64_t> head;      // Номер следующей публикации
+    SnapshotEntry entries[SNAPSHOT_SLOTS];
+};
+
+// Согласованный снимок счётчика для читателя
+struct CounterSnapshot {
+    int64_t value;
+    int32_t writerPid;
+    int64_t updateNs;
+};
+
+// Кэш префикса меток времени лога "YYYY-MM-DD HH:MM:SS" под seqlock. Префикс пересчитывает
+// раз в секунду тот процесс, который первым увидел новую секунду; остальные только дописывают
+// миллисекунды. Текст хранится словами std::atomic, чтобы чтение под seqlock не было гонкой.
+// Писатель, завершившийся посреди обновления, оставляет seq нечётным: метки дальше
+// форматируются без кэша, но остаются верными
+struct alignas(64) TimePrefixCache {
+    std::atomic<uint32_t> seq;      // Нечётное - префикс обновляется
+    std::atomic<int64_t> second;    // Секунда эпохи, для которой сформирован префикс
+    std::atomic<uint64_t> text[3];  // TIME_PREFIX_LEN байт префикса
+};
+static_assert(sizeof(uint64_t) * 3 >= TIME_PREFIX_LEN, "Префикс метки времени не помещается в TimePrefixCache");
+
+// Аренда роли мастера: мастер продлевает её из своего цикла событий, слейвы ждут на futex epoch
+// и забирают роль, если продления не было дольше leaseMs или мастер уже завершился (Linux)
+struct alignas(64) MasterLease {
+    std::atomic<uint32_t> epoch;      // futex-слово: меняется при каждой смене владельца
+    std::atomic<uint64_t> owner;      // Номер смены владельца << 32 | PID; PID 0 - ещё не назначен, -1 - мастер завершился штатно
+    std::atomic<int64_t> heartbeatNs; // Последнее продление, CLOCK_MONOTONIC
+    std::atomic<int32_t> leaseMs;     // Срок аренды; 0 - перехват выключен
+};
+
+#ifdef __linux__
+// Счётчики блокировки; меняются только владельцем, поэтому не добавляют борьбы за кэш-линию
+struct ShmLockStats {
+    std::atomic<uint64_t> acquisitions;
+    std::atomic<uint64_t> contended;   // Захваты, которым пришлось ждать
+    std::atomic<uint64_t> spins;       // Итерации ожидания с pause до успеха или засыпания
+    std::atomic<uint64_t> futexWaits;  // Засыпания на futex
+    std::atomic<uint64_t> ownerDeaths; // Захваты у завершившегося владельца
+};
+
+// Межпроцессная блокировка: слово 0 - свободна, иначе TID владельца и бит ждущих
+struct ShmLock {
+    alignas(64) std::atomic<uint32_t> word;
+    std::atomic<uint32_t> spinLimit;   // Адаптивная длина спина, подстраивается под удержание
+    ShmLockStats stats;
+};
+#endif
+
+// Реестр именованных счётчиков: открытая адресация с линейным пробированием.
+// Записи только добавляются, поэтому поиск и вставка обходятся без блокировок
+const size_t COUNTER_NAME_MAX = 31;
+const uint32_t REGISTRY_CAPACITY = 1024; // Степень двойки
+static_assert((REGISTRY_CAPACITY & (REGISTRY_CAPACITY - 1)) == 0, "REGISTRY_CAPACITY должна быть степенью двойки");
+
+// Состояния записи реестра
+enum RegistryEntryState : uint32_t {
+    ENTRY_EMPTY = 0,
+    ENTRY_CLAIMED = 1, // Вставка идёт: имя ещё пишется
+    ENTRY_READY = 2
+};
+
+// Запись реестра: имя и значение в одной кэш-линии, соседние счётчики не мешают друг другу
+struct alignas(64) NamedCounter {
+    std::atomic<uint32_t> state;
+    uint64_t hash;
+    std::atomic<int64_t> value;
+    char name[COUNTER_NAME_MAX + 1];
+};
+static_assert(sizeof(NamedCounter) == 64, "NamedCounter должен занимать одну кэш-линию");
+
+struct CounterRegistry {
+    std::atomic<uint32_t> used;
+    NamedCounter entries[REGISTRY_CAPACITY];
+};
+
 // Структура для разделяемых данных
 struct SharedData {
-    int counter;
+    uint32_t mainCounter; // Индекс записи "counter" в реестре - счётчик протокола мастер/слейв
+    CounterRegistry registry;
+    int backend; // CounterBackend, выбирается мастером при создании памяти
+    int sloppyOps; // Режим sloppy: прибавления копятся в процессе до sloppyOps штук...
+    int sloppyMs;  // ...или sloppyMs мс с первого из них; 0 и 0 - выключен
+    bool binaryLog; // Журнал событий в log.bin (только POSIX)
+    std::atomic<int> logLevel; // LogLevel: порог, выбранный мастером, общий для всех процессов
+
+    std::atomic<int> slotsUsed;   // Верхняя граница занятых слотов
+    CounterSlot slots[MAX_COUNTER_SLOTS];
+
+    CounterSeqlock snapshot;      // Последнее опубликованное значение счётчика
+    alignas(64) std::atomic<uint32_t> changeWaiters;  // Сколько процессов ждут изменения в wait_for_change
+    TimePrefixCache timeCache;    // Префикс меток времени для текстового лога
+    MasterLease lease;            // Кто сейчас мастер
+    char persistPath[256];        // Файл сохранения счётчика; пусто - счётчик живёт только в памяти
 
 #ifndef _WIN32
     pthread_mutex_t mutex; // На POSIX мьютекс включён в структуру
 #endif
+#ifdef __linux__
+    ShmLock lock;          // Блокировка бэкенда futex
+#endif
+#ifndef _WIN32
+    LogRing logRing;       // Лог-записи ждут здесь, пока мастер не запишет их в log.txt
+#endif
+#ifdef __linux__
+    JobQueue jobQueue;     // Задания для пула воркеров
+#endif
 };
 
 // Функция получения текущего времени в строковом формате
@@ -55,6 +464,49 @@ std::string get_current_time_string() {
     return std::string(buffer);
 }
 
+// Кэш префикса меток времени в разделяемой памяти этого процесса; nullptr - память не отображена
+TimePrefixCache* timeCache = nullptr;
+
+// Функция форматирования метки времени лога через общий кэш префикса: при попадании в ту же
+// секунду - копия префикса и три цифры миллисекунд, без localtime и snprintf.
+// Формат как у format_time_ns; буфер вызывающего не меньше TIME_TEXT_SIZE байт
+const char* cached_format_time(int64_t timeNs, char* buf) {
+    if (timeCache == nullptr) {
+        return format_time_ns(timeNs, buf);
+    }
+    TimePrefixCache& cache = *timeCache;
+    int64_t second = timeNs / 1000000000;
+    uint32_t begin = cache.seq.load(std::memory_order_acquire);
+    if ((begin & 1) == 0 && cache.second.load(std::memory_order_relaxed) == second) {
+        uint64_t text[3];
+        for (int i = 0; i < 3; ++i) {
+            text[i] = cache.text[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (cache.seq.load(std::memory_order_relaxed) == begin) {
+            std::memcpy(buf, text, TIME_PREFIX_LEN);
+            format_time_millis(timeNs, buf + TIME_PREFIX_LEN);
+            return buf;
+        }
+    }
+
+    // Промах: форматируем сами и публикуем, если секунда новее закэшированной. Занятый
+    // писатель не ждём - эту метку просто форматируем без кэша
+    format_time_ns(timeNs, buf);
+    if ((begin & 1) == 0 && second > cache.second.load(std::memory_order_relaxed)
+        && cache.seq.compare_exchange_strong(begin, begin + 1, std::memory_order_relaxed)) {
+        std::atomic_thread_fence(std::memory_order_release);
+        uint64_t text[3] = {};
+        std::memcpy(text, buf, TIME_PREFIX_LEN);
+        cache.second.store(second, std::memory_order_relaxed);
+        for (int i = 0; i < 3; ++i) {
+            cache.text[i].store(text[i], std::memory_order_relaxed);
+        }
+        cache.seq.store(begin + 2, std::memory_order_release);
+    }
+    return buf;
+}
+
 // Функция получения идентификатора процесса
 int get_process_id() {
 #ifdef _WIN32
@@ -64,11 +516,34 @@ int get_process_id() {
 #endif
 }
 
+// PID процесса для горячего пути (после fork сбрасывается обработчиком pthread_atfork)
+int cachedPid = 0;
+
+// Функция получения идентификатора процесса без системного вызова
+int cached_process_id() {
+    if (cachedPid == 0) {
+        cachedPid = get_process_id();
+    }
+    return cachedPid;
+}
+
 // Функция задержки на указанное количество миллисекунд
 void sleep_ms(int ms) {
     std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 }
 
+// Функция получения монотонного времени в наносекундах
+int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Функция получения астрономического времени в наносекундах
+int64_t realtime_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 // Глобальные имена для разделяемой памяти и мьютекса
 #ifdef _WIN32
 const char* SHM_NAME = "Global\\MySharedMemory";
@@ -77,413 +552,4807 @@ const char* MUTEX_NAME = "Global\\MyMutex";
 const char* SHM_NAME = "/mysharedmemory";
 #endif
 
-// Функция для инициализации разделяемой памяти и определения роли процесса
-bool initialize_shared_memory(SharedData** sharedData, bool& isMaster) {
-#ifdef _WIN32
-    // Создаём или открываем разделяемую память
-    HANDLE hMapFile = CreateFileMappingA(
-        INVALID_HANDLE_VALUE,
-        NULL,
-        PAGE_READWRITE,
-        0,
-        sizeof(SharedData),
-        SHM_NAME
-    );
+#ifdef __linux__
+// Функция ожидания на futex в разделяемой памяти (не FUTEX_PRIVATE: ждут разные процессы)
+int futex_wait(std::atomic<uint32_t>* addr, uint32_t expected, const struct timespec* timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, expected, timeout, NULL, 0);
+}
 
-    if (hMapFile == NULL) {
-        std::cerr << "[ERROR] CreateFileMapping failed with error: " << GetLastError() << std::endl;
-        return false;
-    }
+// Функция пробуждения ждущих на futex
+int futex_wake(std::atomic<uint32_t>* addr, int count) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, count, NULL, NULL, 0);
+}
 
-    // Определяем роль процесса
-    if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        isMaster = false;
-    } else {
-        isMaster = true;
-    }
+// Бит "есть ждущие" в слове блокировки, как FUTEX_WAITERS у ядра
+const uint32_t LOCK_WAITERS = 0x80000000u;
+const uint32_t LOCK_SPIN_MAX = 1000;
+// Как часто спящий проверяет, жив ли владелец
+const long LOCK_OWNER_CHECK_NS = 100 * 1000 * 1000;
 
-    // Маппируем разделяемую память
-    *sharedData = static_cast<SharedData*>(MapViewOfFile(
-        hMapFile,
-        FILE_MAP_ALL_ACCESS,
-        0,
-        0,
-        sizeof(SharedData)
-    ));
+// TID потока; после fork сбрасывается в reset_process_state_after_fork
+thread_local uint32_t cachedTid = 0;
 
-    if (*sharedData == NULL) {
-        std::cerr << "[ERROR] MapViewOfFile failed with error: " << GetLastError() << std::endl;
-        CloseHandle(hMapFile);
-        return false;
+// Функция получения TID текущего потока без повторных системных вызовов
+uint32_t cached_thread_id() {
+    if (cachedTid == 0) {
+        cachedTid = static_cast<uint32_t>(syscall(SYS_gettid));
     }
+    return cachedTid;
+}
 
-    // Если мастер, инициализируем счётчик
-    if (isMaster) {
-        (*sharedData)->counter = 0;
-        std::cout << "[INFO] Процесс " << get_process_id() << " является Мастером." << std::endl;
+// Функция подсказки процессору, что идёт активное ожидание
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
 
-        // Создаём именованный мьютекс
-        HANDLE hMutex = CreateMutexA(
-            NULL,
-            FALSE,
-            MUTEX_NAME
-        );
+// Функция инициализации блокировки (только мастер, до появления других процессов)
+void shm_lock_init(ShmLock& lock) {
+    lock.word.store(0);
+    lock.spinLimit.store(100);
+    lock.stats.acquisitions.store(0);
+    lock.stats.contended.store(0);
+    lock.stats.spins.store(0);
+    lock.stats.futexWaits.store(0);
+    lock.stats.ownerDeaths.store(0);
+}
 
-        if (hMutex == NULL) {
-            std::cerr << "[ERROR] CreateMutex failed with error: " << GetLastError() << std::endl;
-            UnmapViewOfFile(*sharedData);
-            CloseHandle(hMapFile);
-            return false;
-        }
+// Функция проверки, жив ли поток-владелец (аналог EOWNERDEAD у robust-мьютекса).
+// Переиспользование TID за время удержания считается невозможным
+bool lock_owner_alive(uint32_t owner) {
+    return kill(static_cast<pid_t>(owner), 0) == 0 || errno != ESRCH;
+}
 
-        CloseHandle(hMutex); // Закрываем дескриптор мьютекса
-    } else {
-        std::cout << "[INFO] Процесс " << get_process_id() << " является Слейвом." << std::endl;
+// Функция захвата блокировки: CAS, затем короткий спин с pause, затем сон на futex.
+// ownerDied = true, если блокировка отобрана у завершившегося владельца
+void shm_lock_acquire(ShmLock& lock, bool& ownerDied) {
+    uint32_t self = cached_thread_id();
+    uint32_t expected = 0;
+    ownerDied = false;
+    if (lock.word.compare_exchange_strong(expected, self, std::memory_order_acquire)) {
+        lock.stats.acquisitions.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
 
-    CloseHandle(hMapFile); // Закрываем дескриптор разделяемой памяти
-    return true;
-
-#else
-    // POSIX: Используем O_CREAT | O_EXCL для определения роли
-    int shm_fd = shm_open(SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
-    if (shm_fd >= 0) {
-        // Успешно создали, процесс - мастер
-        isMaster = true;
-        std::cout << "[INFO] Процесс " << get_process_id() << " является Мастером." << std::endl;
-        // Устанавливаем размер разделяемой памяти
-        if (ftruncate(shm_fd, sizeof(SharedData)) == -1) {
-            perror("[ERROR] ftruncate");
-            close(shm_fd);
-            return false;
+    // Спин: владелец, скорее всего, вот-вот отпустит (counter += 1 длится наносекунды)
+    uint32_t limit = lock.spinLimit.load(std::memory_order_relaxed);
+    uint32_t spins = 0;
+    bool acquired = false;
+    while (spins < limit) {
+        ++spins;
+        cpu_relax();
+        expected = 0;
+        if (lock.word.load(std::memory_order_relaxed) == 0
+            && lock.word.compare_exchange_weak(expected, self, std::memory_order_acquire)) {
+            acquired = true;
+            break;
         }
-    } else {
-        if (errno == EEXIST) {
-            // Разделяемая память уже существует, процесс - слейв
-            shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
-            if (shm_fd < 0) {
-                perror("[ERROR] shm_open");
-                return false;
+    }
+
+    uint64_t waits = 0;
+    while (!acquired) {
+        uint32_t current = lock.word.load(std::memory_order_relaxed);
+        uint32_t owner = current & ~LOCK_WAITERS;
+        if (current == 0 || !lock_owner_alive(owner)) {
+            // Свободна или владелец умер: забираем, сохраняя бит ждущих - кто-то может спать
+            if (lock.word.compare_exchange_weak(current, self | LOCK_WAITERS, std::memory_order_acquire)) {
+                ownerDied = current != 0;
+                acquired = true;
             }
-            isMaster = false;
-            std::cout << "[INFO] Процесс " << get_process_id() << " является Слейвом." << std::endl;
-        } else {
-            perror("[ERROR] shm_open");
-            return false;
+            continue;
+        }
+        if (!(current & LOCK_WAITERS)
+            && !lock.word.compare_exchange_weak(current, current | LOCK_WAITERS, std::memory_order_relaxed)) {
+            continue;
         }
+        // Сон с таймаутом: умерший владелец не разбудит, его замечает проверка выше
+        struct timespec timeout = { 0, LOCK_OWNER_CHECK_NS };
+        futex_wait(&lock.word, current | LOCK_WAITERS, &timeout);
+        ++waits;
     }
 
-    // Маппируем разделяемую память
-    *sharedData = static_cast<SharedData*>(mmap(NULL, sizeof(SharedData),
-                                               PROT_READ | PROT_WRITE,
-                                               MAP_SHARED,
-                                               shm_fd, 0));
-    if (*sharedData == MAP_FAILED) {
-        perror("[ERROR] mmap");
-        close(shm_fd);
-        return false;
+    // Адаптация: успели в спине - спин окупается, нет - укорачиваем его
+    if (waits == 0) {
+        lock.spinLimit.store(std::min(LOCK_SPIN_MAX, limit + limit / 8 + 1), std::memory_order_relaxed);
+    } else {
+        lock.spinLimit.store(std::max(10u, limit - limit / 8), std::memory_order_relaxed);
+    }
+    lock.stats.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    lock.stats.contended.fetch_add(1, std::memory_order_relaxed);
+    lock.stats.spins.fetch_add(spins, std::memory_order_relaxed);
+    lock.stats.futexWaits.fetch_add(waits, std::memory_order_relaxed);
+    if (ownerDied) {
+        lock.stats.ownerDeaths.fetch_add(1, std::memory_order_relaxed);
     }
+}
 
-    close(shm_fd); // Файловый дескриптор больше не нужен
+// Функция освобождения блокировки; futex_wake - только если кто-то спит
+void shm_lock_release(ShmLock& lock) {
+    if (lock.word.exchange(0, std::memory_order_release) & LOCK_WAITERS) {
+        futex_wake(&lock.word, 1);
+    }
+}
+#endif
 
-    // Если мастер, инициализируем счётчик и мьютекс
-    if (isMaster) {
-        (*sharedData)->counter = 0;
+// Функция хеширования имени счётчика (FNV-1a)
+uint64_t counter_name_hash(const char* name) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const char* c = name; *c; ++c) {
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ULL;
+    }
+    return hash;
+}
 
-        pthread_mutexattr_t attr;
-        if (pthread_mutexattr_init(&attr) != 0) {
-            std::cerr << "[ERROR] pthread_mutexattr_init failed." << std::endl;
-            munmap(*sharedData, sizeof(SharedData));
-            return false;
+// Функция поиска счётчика по имени; create = true - добавить, если его ещё нет.
+// Возвращённый указатель - дескриптор: дальше счётчик меняется через него без поиска
+NamedCounter* open_counter(SharedData* sd, const char* name, bool create = true) {
+    if (std::strlen(name) > COUNTER_NAME_MAX) {
+        std::cerr << "[ERROR] Слишком длинное имя счётчика: " << name << std::endl;
+        return nullptr;
+    }
+    CounterRegistry& registry = sd->registry;
+    uint64_t hash = counter_name_hash(name);
+    for (uint32_t probe = 0; probe < REGISTRY_CAPACITY; ++probe) {
+        NamedCounter& entry = registry.entries[(hash + probe) & (REGISTRY_CAPACITY - 1)];
+        uint32_t state = entry.state.load(std::memory_order_acquire);
+        if (state == ENTRY_EMPTY) {
+            if (!create) {
+                return nullptr; // Цепочка кончилась: такого имени нет
+            }
+            if (entry.state.compare_exchange_strong(state, ENTRY_CLAIMED, std::memory_order_acquire)) {
+                entry.hash = hash;
+                std::strncpy(entry.name, name, COUNTER_NAME_MAX);
+                entry.name[COUNTER_NAME_MAX] = '\0';
+                entry.value.store(0, std::memory_order_relaxed);
+                registry.used.fetch_add(1, std::memory_order_relaxed);
+                entry.state.store(ENTRY_READY, std::memory_order_release);
+                return &entry;
+            }
         }
-
-        if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0) {
-            std::cerr << "[ERROR] pthread_mutexattr_setpshared failed." << std::endl;
-            pthread_mutexattr_destroy(&attr);
-            munmap(*sharedData, sizeof(SharedData));
-            return false;
+        // Чужая вставка в эту ячейку ещё не закончена - имя может оказаться нашим
+        while (state != ENTRY_READY) {
+            std::this_thread::yield();
+            state = entry.state.load(std::memory_order_acquire);
         }
-
-        if (pthread_mutex_init(&(*sharedData)->mutex, &attr) != 0) {
-            std::cerr << "[ERROR] pthread_mutex_init failed." << std::endl;
-            pthread_mutexattr_destroy(&attr);
-            munmap(*sharedData, sizeof(SharedData));
-            return false;
+        if (entry.hash == hash && std::strcmp(entry.name, name) == 0) {
+            return &entry;
         }
-
-        pthread_mutexattr_destroy(&attr);
     }
+    std::cerr << "[ERROR] Реестр счётчиков заполнен." << std::endl;
+    return nullptr;
+}
 
+// Функция получения счётчика протокола мастер/слейв.
+// В режиме sharded это база, к которой прибавляются слоты
+inline std::atomic<int64_t>& main_counter(SharedData* sd) {
+    return sd->registry.entries[sd->mainCounter].value;
+}
+
+// Функция создания реестра и счётчика протокола (только мастер)
+void init_counter_registry(SharedData* sd) {
+    for (NamedCounter& entry : sd->registry.entries) {
+        entry.state.store(ENTRY_EMPTY, std::memory_order_relaxed);
+    }
+    sd->registry.used.store(0);
+    NamedCounter* counter = open_counter(sd, "counter");
+    sd->mainCounter = static_cast<uint32_t>(counter - sd->registry.entries);
+}
+
+#ifdef __linux__
+// Растущая арена в отдельном сегменте (<SHM_NAME>_arena). Каждый процесс отображает её
+// по своему адресу, поэтому ссылки внутри арены - смещения от её начала (offset_ptr)
+const uint64_t ARENA_INITIAL_SIZE = 64 * 1024;
+const uint64_t ARENA_MAX_SIZE = 1ULL << 30;   // Резерв адресов в каждом процессе
+const int ARENA_CLASSES = 13;                 // Размеры блоков 16 байт .. 64 КБ
+const uint32_t ARENA_BLOCK_MAGIC = 0xA7E4A5B1u;
+const uint64_t ARENA_OFFSET_MASK = (1ULL << 40) - 1; // Остальные биты головы списка - счётчик ABA
+
+// Заголовок сегмента арены
+struct ArenaHeader {
+    std::atomic<uint64_t> size;   // Текущий размер сегмента; растёт только под growLock
+    std::atomic<uint64_t> top;    // Граница выделенной области
+    std::atomic<uint64_t> grows;
+    ShmLock growLock;
+    std::atomic<uint64_t> freeLists[ARENA_CLASSES]; // Головы списков свободных блоков по классам
+};
+
+// Заголовок блока; у свободного блока в next хранится смещение следующего свободного
+struct ArenaBlock {
+    uint32_t sizeClass;
+    uint32_t magic;
+    std::atomic<uint64_t> next;
+};
+static_assert(sizeof(ArenaBlock) == 16, "ArenaBlock должен занимать 16 байт");
+
+// Отображение арены в текущем процессе
+struct ShmArena {
+    char* base = nullptr;            // Начало зарезервированного диапазона адресов
+    int fd = -1;
+    std::atomic<uint64_t> mapped{0}; // Сколько байт сегмента отображено в этом процессе
+    std::mutex remapMutex;
+    std::string name;
+};
+ShmArena arena;
+
+// Функция расширения отображения арены до end байт. Сегмент отображается поверх
+// зарезервированного диапазона по тому же адресу, поэтому прежние указатели остаются верными
+bool arena_map_upto(uint64_t end) {
+    if (end <= arena.mapped.load(std::memory_order_acquire)) {
+        return true;
+    }
+    std::lock_guard<std::mutex> guard(arena.remapMutex);
+    ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena.base);
+    uint64_t size = header->size.load(std::memory_order_acquire);
+    if (end > size) {
+        return false;
+    }
+    if (size > arena.mapped.load(std::memory_order_relaxed)) {
+        if (mmap(arena.base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, arena.fd, 0) == MAP_FAILED) {
+            perror("[ERROR] mmap arena");
+            return false;
+        }
+        arena.mapped.store(size, std::memory_order_release);
+    }
+    return true;
+}
+
+// Функция получения адреса по смещению в арене (с расширением отображения при росте сегмента)
+void* arena_resolve(uint64_t offset, size_t size) {
+    if (offset == 0 || !arena_map_upto(offset + size)) {
+        return nullptr;
+    }
+    return arena.base + offset;
+}
+
+// Указатель внутри арены: смещение от начала сегмента, одинаковое во всех процессах.
+// Смещение 0 занято заголовком и означает nullptr
+template <typename T>
+struct offset_ptr {
+    uint64_t offset = 0;
+
+    T* get() const { return static_cast<T*>(arena_resolve(offset, sizeof(T))); }
+    T* operator->() const { return get(); }
+    T& operator*() const { return *get(); }
+    explicit operator bool() const { return offset != 0; }
+};
+
+// Функция открытия арены: мастер создаёт сегмент заново, слейв подключается к существующему
+bool open_shared_arena(bool isMaster) {
+    arena.name = std::string(SHM_NAME) + "_arena";
+    if (isMaster) {
+        shm_unlink(arena.name.c_str()); // Арена прежнего мастера, завершившегося аварийно
+        arena.fd = shm_open(arena.name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (arena.fd >= 0 && ftruncate(arena.fd, ARENA_INITIAL_SIZE) == -1) {
+            perror("[ERROR] ftruncate arena");
+            close(arena.fd);
+            arena.fd = -1;
+        }
+    } else {
+        arena.fd = shm_open(arena.name.c_str(), O_RDWR, 0666);
+    }
+    if (arena.fd < 0) {
+        perror("[ERROR] shm_open arena");
+        return false;
+    }
+
+    // Резервируем адреса под максимальный размер, чтобы рост не сдвигал арену
+    void* reserved = mmap(NULL, ARENA_MAX_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED
+        || mmap(reserved, sizeof(ArenaHeader), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, arena.fd, 0) == MAP_FAILED) {
+        perror("[ERROR] mmap arena");
+        if (reserved != MAP_FAILED) {
+            munmap(reserved, ARENA_MAX_SIZE);
+        }
+        close(arena.fd);
+        arena.fd = -1;
+        return false;
+    }
+    arena.base = static_cast<char*>(reserved);
+    arena.mapped.store(0);
+
+    ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena.base);
+    if (isMaster) {
+        header->top.store((sizeof(ArenaHeader) + 63) & ~63ULL);
+        header->grows.store(0);
+        shm_lock_init(header->growLock);
+        for (std::atomic<uint64_t>& head : header->freeLists) {
+            head.store(0);
+        }
+        header->size.store(ARENA_INITIAL_SIZE, std::memory_order_release);
+    }
+    return arena_map_upto(sizeof(ArenaHeader));
+}
+
+// Функция закрытия арены; мастер удаляет сегмент
+void close_shared_arena(bool isMaster) {
+    if (arena.base == nullptr) {
+        return;
+    }
+    munmap(arena.base, ARENA_MAX_SIZE);
+    close(arena.fd);
+    arena.base = nullptr;
+    arena.fd = -1;
+    arena.mapped.store(0);
+    if (isMaster) {
+        shm_unlink(arena.name.c_str());
+    }
+}
+
+// Функция роста сегмента до end байт: удвоение, под блокировкой, чтобы размер не уменьшился
+bool arena_grow(uint64_t end) {
+    ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena.base);
+    if (header->size.load(std::memory_order_acquire) >= end) {
+        return true;
+    }
+    if (end > ARENA_MAX_SIZE) {
+        return false;
+    }
+    bool ownerDied;
+    shm_lock_acquire(header->growLock, ownerDied);
+    uint64_t size = header->size.load(std::memory_order_relaxed);
+    bool ok = true;
+    if (size < end) {
+        uint64_t newSize = size;
+        while (newSize < end) {
+            newSize *= 2;
+        }
+        newSize = std::min(newSize, ARENA_MAX_SIZE);
+        if (ftruncate(arena.fd, newSize) == -1) {
+            perror("[ERROR] ftruncate arena");
+            ok = false;
+        } else {
+            header->size.store(newSize, std::memory_order_release);
+            header->grows.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    shm_lock_release(header->growLock);
+    return ok;
+}
+
+// Функция выделения size байт в арене, возвращает смещение (0 - не удалось).
+// Блоки одного класса переиспользуются через список свободных без блокировок
+uint64_t arena_alloc(size_t size) {
+    if (arena.base == nullptr) {
+        return 0;
+    }
+    int sizeClass = 0;
+    while (sizeClass < ARENA_CLASSES && (16u << sizeClass) < size) {
+        ++sizeClass;
+    }
+    if (sizeClass == ARENA_CLASSES) {
+        std::cerr << "[ERROR] Слишком большой блок для арены: " << size << std::endl;
+        return 0;
+    }
+    ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena.base);
+
+    // Снимаем блок со списка свободных. Счётчик в старших битах головы защищает от ABA:
+    // блок могли снять и вернуть, пока мы читали его next
+    std::atomic<uint64_t>& list = header->freeLists[sizeClass];
+    uint64_t head = list.load(std::memory_order_acquire);
+    while ((head & ARENA_OFFSET_MASK) != 0) {
+        uint64_t offset = head & ARENA_OFFSET_MASK;
+        ArenaBlock* block = static_cast<ArenaBlock*>(arena_resolve(offset, sizeof(ArenaBlock)));
+        uint64_t next = block->next.load(std::memory_order_relaxed);
+        uint64_t newHead = (next & ARENA_OFFSET_MASK) | ((head & ~ARENA_OFFSET_MASK) + (1ULL << 40));
+        if (list.compare_exchange_weak(head, newHead, std::memory_order_acquire)) {
+            return offset + sizeof(ArenaBlock);
+        }
+    }
+
+    // Свободных нет - отрезаем новый блок с конца, при нехватке места растим сегмент
+    uint64_t blockSize = sizeof(ArenaBlock) + (16u << sizeClass);
+    uint64_t offset = header->top.fetch_add(blockSize, std::memory_order_relaxed);
+    if (!arena_grow(offset + blockSize) || !arena_map_upto(offset + blockSize)) {
+        std::cerr << "[ERROR] Арена исчерпана." << std::endl;
+        return 0;
+    }
+    ArenaBlock* block = reinterpret_cast<ArenaBlock*>(arena.base + offset);
+    block->sizeClass = static_cast<uint32_t>(sizeClass);
+    block->magic = ARENA_BLOCK_MAGIC;
+    return offset + sizeof(ArenaBlock);
+}
+
+// Функция освобождения блока, выделенного arena_alloc (возврат в список свободных своего класса)
+void arena_free(uint64_t offset) {
+    if (offset == 0) {
+        return;
+    }
+    uint64_t blockOffset = offset - sizeof(ArenaBlock);
+    ArenaBlock* block = static_cast<ArenaBlock*>(arena_resolve(blockOffset, sizeof(ArenaBlock)));
+    if (block == nullptr || block->magic != ARENA_BLOCK_MAGIC || block->sizeClass >= ARENA_CLASSES) {
+        std::cerr << "[ERROR] arena_free: смещение " << offset << " не является блоком арены." << std::endl;
+        return;
+    }
+    ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena.base);
+    std::atomic<uint64_t>& list = header->freeLists[block->sizeClass];
+    uint64_t head = list.load(std::memory_order_relaxed);
+    do {
+        block->next.store(head & ARENA_OFFSET_MASK, std::memory_order_relaxed);
+    } while (!list.compare_exchange_weak(head, blockOffset | ((head & ~ARENA_OFFSET_MASK) + (1ULL << 40)),
+                                         std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Функция выделения объекта T в арене
+template <typename T>
+offset_ptr<T> arena_new() {
+    offset_ptr<T> ptr;
+    ptr.offset = arena_alloc(sizeof(T));
+    if (ptr) {
+        new (ptr.get()) T();
+    }
+    return ptr;
+}
+#endif
+
+#ifndef _WIN32
+// Файл сохранения счётчика, отображённый в память всех процессов. Каждая публикация
+// снимка дописывает запись в кольцо WAL; мастер раз в секунду делает контрольную точку
+// и msync. Запись - это обращение к странице page cache, без системных вызовов
+const uint64_t PERSIST_MAGIC = 0x3153524550335748ULL; // "HW3PERS1"
+const uint32_t PERSIST_WAL_CAPACITY = 4096;
+const int PERSIST_CHECKPOINT_MS = 1000;
+
+// Запись WAL: значение счётчика после операции
+struct PersistRecord {
+    std::atomic<uint64_t> seq; // 0 - запись пуста или недописана; пишется последним
+    int64_t value;
+    uint64_t check;            // seq ^ value ^ PERSIST_MAGIC: отсекает наполовину сброшенные на диск
+};
+
+struct PersistFile {
+    uint64_t magic;
+    std::atomic<uint64_t> checkpointSeq;   // Последняя запись WAL, учтённая в контрольной точке
+    std::atomic<int64_t> checkpointValue;
+    std::atomic<uint64_t> walSeq;          // Номер последней записи WAL
+    PersistRecord wal[PERSIST_WAL_CAPACITY];
+};
+
+// Отображение файла сохранения в текущем процессе
+PersistFile* persistFile = nullptr;
+
+// Функция добавления записи в WAL. Вызывается после публикации снимка без блокировок:
+// при гонке писателей последняя запись может на время отстать от счётчика, до следующей
+void persist_append(int64_t value) {
+    uint64_t seq = persistFile->walSeq.fetch_add(1, std::memory_order_relaxed) + 1;
+    PersistRecord& record = persistFile->wal[seq % PERSIST_WAL_CAPACITY];
+    record.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.value = value;
+    record.check = seq ^ static_cast<uint64_t>(value) ^ PERSIST_MAGIC;
+    record.seq.store(seq, std::memory_order_release);
+}
+
+// Функция восстановления: контрольная точка плюс самая свежая целая запись WAL после неё
+int64_t persist_recover(const PersistFile* pf, uint64_t& lastSeq) {
+    int64_t value = pf->checkpointValue.load();
+    lastSeq = pf->checkpointSeq.load();
+    for (const PersistRecord& record : pf->wal) {
+        uint64_t seq = record.seq.load(std::memory_order_acquire);
+        if (seq > lastSeq && record.check == (seq ^ static_cast<uint64_t>(record.value) ^ PERSIST_MAGIC)) {
+            lastSeq = seq;
+            value = record.value;
+        }
+    }
+    return value;
+}
+
+// Функция открытия файла сохранения. Мастер создаёт файл или восстанавливает из него
+// значение (recovered = true), слейв только отображает его
+bool open_persist_file(const char* path, bool isMaster, int64_t& value, bool& recovered) {
+    recovered = false;
+    int fd = open(path, O_RDWR | (isMaster ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        perror("[ERROR] open persist file");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("[ERROR] fstat persist file");
+        close(fd);
+        return false;
+    }
+    bool fresh = st.st_size != static_cast<off_t>(sizeof(PersistFile));
+    if (fresh && (!isMaster || ftruncate(fd, 0) == -1 || ftruncate(fd, sizeof(PersistFile)) == -1)) {
+        std::cerr << "[ERROR] Файл сохранения " << path << " повреждён или не создан." << std::endl;
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, sizeof(PersistFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror("[ERROR] mmap persist file");
+        return false;
+    }
+    persistFile = static_cast<PersistFile*>(mapped);
+
+    if (isMaster) {
+        if (!fresh && persistFile->magic == PERSIST_MAGIC) {
+            uint64_t lastSeq;
+            value = persist_recover(persistFile, lastSeq);
+            persistFile->walSeq.store(lastSeq);
+            recovered = true;
+        } else {
+            std::memset(mapped, 0, sizeof(PersistFile));
+            persistFile->magic = PERSIST_MAGIC;
+            value = 0;
+        }
+    }
+    return true;
+}
+
+// Функция контрольной точки (только мастер): номер записи читается до значения, поэтому
+// более новая запись WAL при восстановлении не может оказаться старше точки
+void persist_checkpoint(int64_t value, uint64_t seq) {
+    persistFile->checkpointValue.store(value);
+    persistFile->checkpointSeq.store(seq);
+    if (msync(persistFile, sizeof(PersistFile), MS_SYNC) == -1) {
+        perror("[ERROR] msync");
+    }
+}
+
+// Функция закрытия файла сохранения
+void close_persist_file() {
+    if (persistFile != nullptr) {
+        munmap(persistFile, sizeof(PersistFile));
+        persistFile = nullptr;
+    }
+}
+#endif
+
+// Функция пробуждения подписчиков после публикации снимка. seq снимка служит futex-словом:
+// отдельного номера изменений нет, а без подписчиков пробуждение не стоит ни одного syscall
+void notify_change(SharedData* sd) {
+    // Запись seq должна стать видна до чтения changeWaiters, иначе подписчик может
+    // уснуть на старом seq, а писатель - не увидеть его (пара к барьеру в wait_for_change)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sd->changeWaiters.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+#ifdef __linux__
+    futex_wake(&sd->snapshot.seq, INT_MAX);
+#endif
+}
+
+// Функция ожидания изменения счётчика: возвращает true, когда опубликован снимок новее
+// lastSeq (seq - его номер), false - по таймауту (timeoutMs < 0 - без таймаута)
+bool wait_for_change(SharedData* sd, uint32_t lastSeq, int timeoutMs, uint32_t& seq) {
+    std::atomic<uint32_t>& word = sd->snapshot.seq;
+    int64_t deadline = timeoutMs < 0 ? 0 : monotonic_ns() + timeoutMs * 1000000LL;
+    sd->changeWaiters.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool changed = false;
+    while (true) {
+        seq = word.load(std::memory_order_acquire);
+        if (seq != lastSeq) {
+            changed = true;
+            break;
+        }
+        int64_t left = timeoutMs < 0 ? 1 : deadline - monotonic_ns();
+        if (left <= 0) {
+            break;
+        }
+#ifdef __linux__
+        // Ядро сравнит слово с seq атомарно: публикация после чтения выше не потеряется
+        struct timespec timeout = { static_cast<time_t>(left / 1000000000), static_cast<long>(left % 1000000000) };
+        futex_wait(&word, seq, timeoutMs < 0 ? nullptr : &timeout);
+#else
+        sleep_ms(1); // Без futex - короткий опрос
+#endif
+    }
+    sd->changeWaiters.fetch_sub(1);
+    return changed;
+}
+
+#ifdef __linux__
+// Функция упаковки слова владельца аренды
+inline uint64_t lease_word(uint32_t change, int32_t pid) {
+    return static_cast<uint64_t>(change) << 32 | static_cast<uint32_t>(pid);
+}
+
+// Функция получения PID владельца из слова аренды
+inline int32_t lease_owner(uint64_t word) {
+    return static_cast<int32_t>(static_cast<uint32_t>(word));
+}
+
+// Функция назначения владельца без перехвата (инициализация сегмента)
+void lease_assign(MasterLease& lease, int32_t pid) {
+    lease.heartbeatNs.store(monotonic_ns(), std::memory_order_release);
+    uint64_t word = lease.owner.load(std::memory_order_relaxed);
+    lease.owner.store(lease_word(static_cast<uint32_t>(word >> 32) + 1, pid), std::memory_order_release);
+}
+
+// Функция проверки, истекла ли аренда владельца owner: продления не было дольше срока
+// или процесс-владелец уже завершился (тогда ждать истечения срока незачем)
+bool lease_expired(const MasterLease& lease, int32_t owner, int64_t now) {
+    if (owner <= 0) {
+        return false; // Мастер ещё не назначен или сам удалил сегмент
+    }
+    if (now - lease.heartbeatNs.load(std::memory_order_acquire) > lease.leaseMs.load() * 1000000LL) {
+        return true;
+    }
+    return kill(owner, 0) == -1 && errno == ESRCH;
+}
+
+// Функция продления аренды владельцем. Вызывается из цикла событий мастера, а не из отдельного
+// потока: зависший цикл перестаёт продлевать аренду. false - роль уже перехвачена
+bool lease_renew(MasterLease& lease, int32_t self) {
+    if (lease_owner(lease.owner.load(std::memory_order_acquire)) != self) {
+        return false;
+    }
+    lease.heartbeatNs.store(monotonic_ns(), std::memory_order_release);
+    return true;
+}
+
+// Функция попытки перехватить истёкшую аренду. Продление записывается до CAS слова владельца:
+// кто увидел нового владельца, видит и его свежее продление и не сочтёт аренду истёкшей.
+// Номер смены в слове не даёт двум претендентам, прочитавшим одно слово, выиграть оба.
+// previousOwner - у кого роль перехвачена
+bool lease_try_take_over(MasterLease& lease, int32_t self, int32_t& previousOwner) {
+    uint64_t word = lease.owner.load(std::memory_order_acquire);
+    int32_t owner = lease_owner(word);
+    if (owner == self || !lease_expired(lease, owner, monotonic_ns())) {
+        return false;
+    }
+    lease.heartbeatNs.store(monotonic_ns(), std::memory_order_release);
+    if (!lease.owner.compare_exchange_strong(word, lease_word(static_cast<uint32_t>(word >> 32) + 1, self),
+                                             std::memory_order_acq_rel)) {
+        return false;
+    }
+    lease.epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(&lease.epoch, INT_MAX);
+    previousOwner = owner;
+    return true;
+}
+
+// Функция ожидания следующей проверки: смена владельца будит сразу, иначе - четверть срока аренды
+void lease_wait(MasterLease& lease, uint32_t epoch) {
+    long periodNs = lease.leaseMs.load() * 1000000L / 4;
+    struct timespec timeout = { static_cast<time_t>(periodNs / 1000000000), periodNs % 1000000000 };
+    futex_wait(&lease.epoch, epoch, &timeout);
+}
+
+// Функция освобождения аренды при штатном завершении мастера: сегмент удаляется, перехватывать нечего
+void lease_release(MasterLease& lease, int32_t self) {
+    uint64_t word = lease.owner.load(std::memory_order_acquire);
+    if (lease_owner(word) == self &&
+        lease.owner.compare_exchange_strong(word, lease_word(static_cast<uint32_t>(word >> 32) + 1, -1))) {
+        lease.epoch.fetch_add(1, std::memory_order_release);
+        futex_wake(&lease.epoch, INT_MAX);
+    }
+}
+#endif
+
+#ifndef _WIN32
+// История значений счётчика (<SHM_NAME>_history), nullptr - история не ведётся
+HistorySegment* historySegment = nullptr;
+
+// Функция открытия сегмента истории. Мастер создаёт его заново: история прежнего
+// мастера относится к другому счётчику
+bool open_history_segment(bool isMaster) {
+    std::string name = std::string(SHM_NAME) + "_history";
+    int fd;
+    if (isMaster) {
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd >= 0 && ftruncate(fd, sizeof(HistorySegment)) == -1) {
+            perror("[ERROR] ftruncate history");
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        fd = shm_open(name.c_str(), O_RDWR, 0666);
+    }
+    if (fd < 0) {
+        perror("[ERROR] shm_open history");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(HistorySegment)) {
+        std::cerr << "[ERROR] Сегмент истории ещё не создан мастером." << std::endl;
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(NULL, sizeof(HistorySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("[ERROR] mmap history");
+        return false;
+    }
+    historySegment = static_cast<HistorySegment*>(addr);
+    if (isMaster) {
+        historySegment->capacity = HISTORY_CAPACITY;
+        std::memcpy(historySegment->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+    }
+    return true;
+}
+
+// Функция закрытия сегмента истории; мастер удаляет его
+void close_history_segment(bool isMaster) {
+    if (historySegment != nullptr) {
+        munmap(historySegment, sizeof(HistorySegment));
+        historySegment = nullptr;
+        if (isMaster) {
+            shm_unlink((std::string(SHM_NAME) + "_history").c_str());
+        }
+    }
+}
+#endif
+
+// Функция публикации снимка счётчика без блокировок: номер ячейки даёт fetch_add, значение
+// счётчика читается уже после него, поэтому снимок с большим номером не старше снимка
+// с меньшим. Затем - записи WAL и истории: op - операция, после которой опубликовано значение
+void publish_counter_snapshot(SharedData* sd, int pid, uint32_t op) {
+    CounterSeqlock& snap = sd->snapshot;
+    uint64_t ticket;
+    SnapshotEntry* claimed = nullptr;
+    while (claimed == nullptr) {
+        ticket = snap.head.fetch_add(1);
+        SnapshotEntry& entry = snap.entries[ticket & (SNAPSHOT_SLOTS - 1)];
+        // Ячейку занимает CAS с чётного seq меньшего номера. Если в ней ещё пишет отставший
+        // писатель (seq нечётный) или её уже занял номер новее, берём следующий номер:
+        // иначе два писателя перемешали бы поля одной ячейки
+        uint64_t current = entry.seq.load(std::memory_order_relaxed);
+        if ((current & 1) == 0 && current < 2 * ticket + 1
+            && entry.seq.compare_exchange_strong(current, 2 * ticket + 1, std::memory_order_relaxed)) {
+            claimed = &entry;
+        }
+    }
+    SnapshotEntry& entry = *claimed;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    int64_t value = main_counter(sd).load();
+    int64_t now = realtime_ns();
+    entry.value.store(value, std::memory_order_relaxed);
+    entry.writerPid.store(pid, std::memory_order_relaxed);
+    entry.updateNs.store(now, std::memory_order_relaxed);
+    entry.seq.store(2 * ticket + 2, std::memory_order_release);
+    snap.seq.fetch_add(2, std::memory_order_release);
+
+#ifndef _WIN32
+    if (persistFile != nullptr) {
+        persist_append(value);
+    }
+    if (historySegment != nullptr) {
+        int64_t full = value;
+        if (sd->backend == BACKEND_SHARDED) {
+            int used = sd->slotsUsed.load(std::memory_order_acquire);
+            for (int i = 0; i < used; ++i) {
+                full += sd->slots[i].delta.load(std::memory_order_relaxed);
+            }
+        }
+        history_append(historySegment, now, full, pid, op);
+    }
+#else
+    (void)op;
+#endif
+    notify_change(sd);
+}
+
+#ifdef __linux__
+// Функция восстановления общих данных после смерти владельца блокировки. Владелец мог
+// успеть изменить счётчик, но не опубликовать снимок: тогда читатели, WAL и история
+// отстают от счётчика. Значение публикуется заново (в WAL и историю - как восстановленное)
+void recover_after_owner_death(SharedData* sd) {
+    int64_t value = main_counter(sd).load(std::memory_order_acquire);
+    publish_counter_snapshot(sd, cached_process_id(), HOP_RECOVER);
+    std::cerr << "[WARN] Владелец блокировки завершился, не освободив её. Блокировка восстановлена, "
+              << "значение счётчика " << value << " опубликовано заново." << std::endl;
+}
+#endif
+
+// Слот гистограмм задержек этого процесса в сегменте <SHM_NAME>_stats (nullptr - не пишем)
+StatsSlot* myStats = nullptr;
+// Роль процесса для инспектора; по умолчанию master или slave
+const char* statsRole = nullptr;
+
+// Функция записи длительности операции в гистограмму этого процесса
+void stats_record(StatKind kind, int64_t ns) {
+    if (myStats != nullptr) {
+        histogram_record(myStats->hist[kind], ns);
+    }
+}
+
+#ifndef _WIN32
+StatsSegment* statsSegment = nullptr;
+
+// Функция занятия слота статистики: сначала свободный, затем слот завершившегося процесса,
+// чьи гистограммы переносятся в общую сумму retired
+StatsSlot* claim_stats_slot(StatsSegment* segment, int32_t pid) {
+    for (StatsSlot& slot : segment->slots) {
+        int32_t expected = 0;
+        if (slot.pid.compare_exchange_strong(expected, pid)) {
+            return &slot;
+        }
+    }
+    for (StatsSlot& slot : segment->slots) {
+        int32_t owner = slot.pid.load();
+        bool gone = owner < 0 || (owner > 0 && kill(owner, 0) == -1 && errno == ESRCH);
+        if (gone && slot.pid.compare_exchange_strong(owner, pid)) {
+            for (int kind = 0; kind < STAT_KIND_COUNT; ++kind) {
+                SharedHistogram& from = slot.hist[kind];
+                SharedHistogram& into = segment->retired[kind];
+                for (int i = 0; i < HIST_BUCKETS; ++i) {
+                    into.counts[i].fetch_add(from.counts[i].exchange(0, std::memory_order_relaxed),
+                                             std::memory_order_relaxed);
+                }
+                into.total.fetch_add(from.total.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+// Функция открытия сегмента статистики и занятия слота. Мастер создаёт сегмент заново
+bool open_stats_segment(bool isMaster) {
+    std::string name = std::string(SHM_NAME) + "_stats";
+    int fd;
+    if (isMaster) {
+        shm_unlink(name.c_str()); // Сегмент прежнего мастера, завершившегося аварийно
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd >= 0 && ftruncate(fd, sizeof(StatsSegment)) == -1) {
+            perror("[ERROR] ftruncate stats");
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        fd = shm_open(name.c_str(), O_RDWR, 0666);
+    }
+    if (fd < 0) {
+        perror("[ERROR] shm_open stats");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(StatsSegment)) {
+        std::cerr << "[ERROR] Сегмент статистики ещё не создан мастером." << std::endl;
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(NULL, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("[ERROR] mmap stats");
+        return false;
+    }
+    statsSegment = static_cast<StatsSegment*>(addr);
+
+    // Сегмент после ftruncate заполнен нулями: мастеру остаётся записать заголовок
+    if (isMaster) {
+        statsSegment->slotCount = STATS_SLOTS;
+        statsSegment->bucketCount = HIST_BUCKETS;
+        std::memcpy(statsSegment->magic, STATS_MAGIC, sizeof(STATS_MAGIC));
+    }
+
+    int32_t pid = cached_process_id();
+    myStats = claim_stats_slot(statsSegment, pid);
+    if (myStats == nullptr) {
+        std::cerr << "[ERROR] Нет свободного слота статистики." << std::endl;
+        return false;
+    }
+    std::strncpy(myStats->role, statsRole != nullptr ? statsRole : (isMaster ? "master" : "slave"),
+                 sizeof(myStats->role) - 1);
+    myStats->startNs = realtime_ns();
     return true;
+}
+
+// Функция закрытия сегмента статистики: слот остаётся с гистограммами, пока его не займут
+void close_stats_segment(bool isMaster) {
+    if (myStats != nullptr) {
+        myStats->pid.store(-cached_process_id());
+        myStats = nullptr;
+    }
+    if (statsSegment != nullptr) {
+        munmap(statsSegment, sizeof(StatsSegment));
+        statsSegment = nullptr;
+        if (isMaster) {
+            shm_unlink((std::string(SHM_NAME) + "_stats").c_str());
+        }
+    }
+}
+#endif
+
+// Настройки, которые выбирает мастер при создании разделяемой памяти
+struct MasterSettings {
+    CounterBackend backend = BACKEND_MUTEX;
+    bool binaryLog = false; // События в log.bin вместо строк в log.txt
+    LogLevel logLevel = LEVEL_DEBUG;
+    std::string persistPath; // Сохранять счётчик в файл и восстанавливать при перезапуске
+    int sloppyOps = 0;       // Пороги сброса локальных прибавлений (режим sloppy)
+    int sloppyMs = 0;
+    int leaseMs = 0;         // Срок аренды роли мастера (--lease-ms), 0 - слейвы роль не перехватывают
+};
+
+// Функция для инициализации разделяемой памяти и определения роли процесса
+bool initialize_shared_memory(SharedData** sharedData, bool& isMaster, const MasterSettings& settings = MasterSettings()) {
+#ifdef _WIN32
+    // Создаём или открываем разделяемую память
+    HANDLE hMapFile = CreateFileMappingA(
+        INVALID_HANDLE_VALUE,
+        NULL,
+        PAGE_READWRITE,
+        0,
+        sizeof(SharedData),
+        SHM_NAME
+    );
+
+    if (hMapFile == NULL) {
+        std::cerr << "[ERROR] CreateFileMapping failed with error: " << GetLastError() << std::endl;
+        return false;
+    }
+
+    // Определяем роль процесса
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        isMaster = false;
+    } else {
+        isMaster = true;
+    }
+
+    // Маппируем разделяемую память
+    *sharedData = static_cast<SharedData*>(MapViewOfFile(
+        hMapFile,
+        FILE_MAP_ALL_ACCESS,
+        0,
+        0,
+        sizeof(SharedData)
+    ));
+
+    if (*sharedData == NULL) {
+        std::cerr << "[ERROR] MapViewOfFile failed with error: " << GetLastError() << std::endl;
+        CloseHandle(hMapFile);
+        return false;
+    }
+
+    // Если мастер, инициализируем счётчик
+    if (isMaster) {
+        init_counter_registry(*sharedData);
+        (*sharedData)->backend = settings.backend;
+        (*sharedData)->sloppyOps = settings.sloppyOps;
+        (*sharedData)->sloppyMs = settings.sloppyMs;
+        (*sharedData)->logLevel.store(settings.logLevel);
+        std::cout << "[INFO] Процесс " << get_process_id() << " является Мастером." << std::endl;
+
+        // Создаём именованный мьютекс
+        HANDLE hMutex = CreateMutexA(
+            NULL,
+            FALSE,
+            MUTEX_NAME
+        );
+
+        if (hMutex == NULL) {
+            std::cerr << "[ERROR] CreateMutex failed with error: " << GetLastError() << std::endl;
+            UnmapViewOfFile(*sharedData);
+            CloseHandle(hMapFile);
+            return false;
+        }
+
+        CloseHandle(hMutex); // Закрываем дескриптор мьютекса
+    } else {
+        std::cout << "[INFO] Процесс " << get_process_id() << " является Слейвом." << std::endl;
+    }
+
+    CloseHandle(hMapFile); // Закрываем дескриптор разделяемой памяти
+    timeCache = &(*sharedData)->timeCache;
+    return true;
+
+#else
+    // POSIX: Используем O_CREAT | O_EXCL для определения роли
+    int shm_fd = shm_open(SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (shm_fd >= 0) {
+        // Успешно создали, процесс - мастер
+        isMaster = true;
+        std::cout << "[INFO] Процесс " << get_process_id() << " является Мастером." << std::endl;
+        // Устанавливаем размер разделяемой памяти
+        if (ftruncate(shm_fd, sizeof(SharedData)) == -1) {
+            perror("[ERROR] ftruncate");
+            close(shm_fd);
+            return false;
+        }
+    } else {
+        if (errno == EEXIST) {
+            // Разделяемая память уже существует, процесс - слейв
+            shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
+            if (shm_fd < 0) {
+                perror("[ERROR] shm_open");
+                return false;
+            }
+            isMaster = false;
+            std::cout << "[INFO] Процесс " << get_process_id() << " является Слейвом." << std::endl;
+        } else {
+            perror("[ERROR] shm_open");
+            return false;
+        }
+    }
+
+    // Маппируем разделяемую память
+    *sharedData = static_cast<SharedData*>(mmap(NULL, sizeof(SharedData),
+                                               PROT_READ | PROT_WRITE,
+                                               MAP_SHARED,
+                                               shm_fd, 0));
+    if (*sharedData == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        close(shm_fd);
+        return false;
+    }
+
+    close(shm_fd); // Файловый дескриптор больше не нужен
+
+    // Если мастер, инициализируем счётчик и мьютекс
+    if (isMaster) {
+        init_counter_registry(*sharedData);
+        (*sharedData)->backend = settings.backend;
+        (*sharedData)->sloppyOps = settings.sloppyOps;
+        (*sharedData)->sloppyMs = settings.sloppyMs;
+        (*sharedData)->logLevel.store(settings.logLevel);
+
+        // Все ячейки кольцевых буферов свободны для первого круга
+        ring_init((*sharedData)->logRing.lines);
+        ring_init((*sharedData)->logRing.events);
+        (*sharedData)->logRing.overflows.store(0, std::memory_order_relaxed);
+        (*sharedData)->logRing.pushes.store(0, std::memory_order_relaxed);
+        (*sharedData)->logRing.drainerSleeping.store(0, std::memory_order_relaxed);
+        (*sharedData)->binaryLog = settings.binaryLog;
+
+#ifdef __linux__
+        ring_init((*sharedData)->jobQueue.jobs);
+        shm_lock_init((*sharedData)->lock);
+
+        MasterLease& lease = (*sharedData)->lease;
+        lease.leaseMs.store(settings.leaseMs);
+        lease_assign(lease, cached_process_id());
+#endif
+
+        pthread_mutexattr_t attr;
+        if (pthread_mutexattr_init(&attr) != 0) {
+            std::cerr << "[ERROR] pthread_mutexattr_init failed." << std::endl;
+            munmap(*sharedData, sizeof(SharedData));
+            return false;
+        }
+
+        if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0) {
+            std::cerr << "[ERROR] pthread_mutexattr_setpshared failed." << std::endl;
+            pthread_mutexattr_destroy(&attr);
+            munmap(*sharedData, sizeof(SharedData));
+            return false;
+        }
+
+        if (pthread_mutex_init(&(*sharedData)->mutex, &attr) != 0) {
+            std::cerr << "[ERROR] pthread_mutex_init failed." << std::endl;
+            pthread_mutexattr_destroy(&attr);
+            munmap(*sharedData, sizeof(SharedData));
+            return false;
+        }
+
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    // История нужна до восстановления из файла: восстановленное значение - её первая запись
+    if (!open_history_segment(isMaster)) {
+        std::cerr << "[ERROR] История счётчика вестись не будет." << std::endl;
+    }
+
+    // Файл сохранения: мастер записывает путь в общую память, остальные открывают его по нему
+    if (isMaster) {
+        std::strncpy((*sharedData)->persistPath, settings.persistPath.c_str(), sizeof((*sharedData)->persistPath) - 1);
+    }
+    if ((*sharedData)->persistPath[0] != '\0') {
+        int64_t value = 0;
+        bool recovered = false;
+        int64_t startNs = monotonic_ns();
+        if (!open_persist_file((*sharedData)->persistPath, isMaster, value, recovered)) {
+            if (isMaster) {
+                munmap(*sharedData, sizeof(SharedData));
+                shm_unlink(SHM_NAME);
+                return false;
+            }
+            std::cerr << "[ERROR] Изменения этого процесса не будут сохраняться в файл." << std::endl;
+        } else if (isMaster) {
+            main_counter(*sharedData).store(value);
+            publish_counter_snapshot(*sharedData, cached_process_id(), HOP_RECOVER);
+            if (recovered) {
+                std::cout << "[INFO] Счётчик восстановлен из " << (*sharedData)->persistPath << ": " << value
+                          << " за " << (monotonic_ns() - startNs) / 1000.0 << " мкс." << std::endl;
+            }
+        }
+    }
+
+#ifdef __linux__
+    // Арена нужна не всем процессам: без неё работает всё, кроме данных переменного размера
+    if (!open_shared_arena(isMaster)) {
+        std::cerr << "[ERROR] Арена в разделяемой памяти недоступна." << std::endl;
+    }
+#endif
+    // Без слота статистики процесс просто не пишет гистограммы
+    open_stats_segment(isMaster);
+    timeCache = &(*sharedData)->timeCache;
+    return true;
+#endif
+}
+
+// Слот счётчика этого потока (режим sharded). У каждого потока свой слот, поэтому
+// копии в режиме --threads прибавляют к разным кэш-линиям, как и копии-процессы
+thread_local CounterSlot* mySlot = nullptr;
+
+// Функция получения слота счётчика этого процесса, nullptr - свободных слотов нет
+CounterSlot* acquire_counter_slot(SharedData* sd) {
+    if (mySlot != nullptr) {
+        return mySlot;
+    }
+    int32_t pid = cached_process_id();
+    for (int i = 0; i < MAX_COUNTER_SLOTS; ++i) {
+        int32_t expected = 0;
+        if (sd->slots[i].ownerPid.compare_exchange_strong(expected, pid)) {
+            int used = sd->slotsUsed.load();
+            while (used < i + 1 && !sd->slotsUsed.compare_exchange_weak(used, i + 1)) {
+            }
+            mySlot = &sd->slots[i];
+            return mySlot;
+        }
+    }
+#ifndef _WIN32
+    // Свободных нет - забираем слот умершего процесса, его delta продолжаем накапливать
+    for (int i = 0; i < MAX_COUNTER_SLOTS; ++i) {
+        int32_t owner = sd->slots[i].ownerPid.load();
+        if (owner > 0 && kill(owner, 0) == -1 && errno == ESRCH
+            && sd->slots[i].ownerPid.compare_exchange_strong(owner, pid)) {
+            mySlot = &sd->slots[i];
+            return mySlot;
+        }
+    }
+#endif
+    return nullptr;
+}
+
+// Функция освобождения слота счётчика при завершении процесса или потока (delta остаётся в слоте)
+void release_counter_slot() {
+    if (mySlot != nullptr) {
+        mySlot->ownerPid.store(0);
+        mySlot = nullptr;
+    }
+}
+
+// Функция захвата мьютекса
+bool acquire_mutex(SharedData* sd, bool isMaster) {
+#ifdef _WIN32
+    // Открываем именованный мьютекс
+    HANDLE hMutex = OpenMutexA(SYNCHRONIZE, FALSE, MUTEX_NAME);
+    if (hMutex == NULL) {
+        std::cerr << "[ERROR] OpenMutex failed with error: " << GetLastError() << std::endl;
+        return false;
+    }
+    DWORD dwWaitResult = WaitForSingleObject(hMutex, INFINITE);
+    if (dwWaitResult != WAIT_OBJECT_0) {
+        std::cerr << "[ERROR] WaitForSingleObject failed with error: " << GetLastError() << std::endl;
+        CloseHandle(hMutex);
+        return false;
+    }
+    CloseHandle(hMutex);
+    return true;
+#else
+#ifdef __linux__
+    if (sd->backend == BACKEND_FUTEX) {
+        bool ownerDied;
+        shm_lock_acquire(sd->lock, ownerDied);
+        if (ownerDied) {
+            recover_after_owner_death(sd);
+        }
+        return true;
+    }
+#endif
+    if (pthread_mutex_lock(&sd->mutex) == 0) {
+        return true;
+    } else {
+        std::cerr << "[ERROR] pthread_mutex_lock failed." << std::endl;
+        return false;
+    }
+#endif
+}
+
+// Функция освобождения мьютекса
+void release_mutex(SharedData* sd, bool isMaster) {
+#ifdef _WIN32
+    // Открываем именованный мьютекс
+    HANDLE hMutex = OpenMutexA(SYNCHRONIZE, FALSE, MUTEX_NAME);
+    if (hMutex != NULL) {
+        if (!ReleaseMutex(hMutex)) {
+            std::cerr << "[ERROR] ReleaseMutex failed with error: " << GetLastError() << std::endl;
+        }
+        CloseHandle(hMutex);
+    } else {
+        std::cerr << "[ERROR] OpenMutex failed during release with error: " << GetLastError() << std::endl;
+    }
+#else
+#ifdef __linux__
+    if (sd->backend == BACKEND_FUTEX) {
+        shm_lock_release(sd->lock);
+        return;
+    }
+#endif
+    if (pthread_mutex_unlock(&sd->mutex) != 0) {
+        std::cerr << "[ERROR] pthread_mutex_unlock failed." << std::endl;
+    }
+#endif
+}
+
+// Функция применения операции к значению счётчика
+int64_t apply_counter_op(int64_t value, CounterOp op, int64_t arg) {
+    switch (op) {
+    case OP_ADD:
+        // Переполнение при конкурентных *2 не должно быть UB, поэтому считаем в беззнаковых
+        return static_cast<int64_t>(static_cast<uint64_t>(value) + static_cast<uint64_t>(arg));
+    case OP_MUL:
+        return static_cast<int64_t>(static_cast<uint64_t>(value) * static_cast<uint64_t>(arg));
+    case OP_DIV:
+        return arg != 0 ? value / arg : value;
+    case OP_SET:
+        return arg;
+    }
+    return value;
+}
+
+// Функция суммирования базы и слотов (режим sharded).
+// Во время переноса слотов в базу сумма может на мгновение не учитывать переносимый слот
+int64_t sharded_counter_sum(SharedData* sd) {
+    int64_t sum = main_counter(sd).load();
+    int used = sd->slotsUsed.load(std::memory_order_acquire);
+    for (int i = 0; i < used; ++i) {
+        sum += sd->slots[i].delta.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+// Функция переноса всех слотов в базу (вызывается под мьютексом), возвращает перенесённое
+int64_t fold_counter_slots(SharedData* sd) {
+    int64_t folded = 0;
+    int used = sd->slotsUsed.load(std::memory_order_acquire);
+    for (int i = 0; i < used; ++i) {
+        folded += sd->slots[i].delta.exchange(0);
+    }
+    return folded;
+}
+
+// Замеры ожидания и удержания блокировки в counter_update (включаются бенчмарком, у каждого потока свои)
+struct LockTiming {
+    LatencyHistogram wait;
+    LatencyHistogram hold;
+};
+thread_local LockTiming* lockTiming = nullptr;
+
+// Функция чтения согласованного снимка счётчика без блокировок.
+// В режиме sharded снимок хранит базу после последней не-аддитивной операции, к ней
+// добавляется текущая сумма слотов; writerPid и updateNs относятся к этой операции
+void read_counter_snapshot(SharedData* sd, CounterSnapshot& out) {
+    CounterSeqlock& snap = sd->snapshot;
+    bool found = false;
+    while (!found) {
+        uint64_t head = snap.head.load(std::memory_order_acquire);
+        if (head == 0) {
+            // Ещё ничего не опубликовано
+            out.value = main_counter(sd).load();
+            out.writerPid = 0;
+            out.updateNs = 0;
+            break;
+        }
+        // От самой свежей ячейки к старым: занятую писателем или затёртую пропускаем
+        for (uint64_t ticket = head - 1; !found && head - ticket <= SNAPSHOT_SLOTS; --ticket) {
+            const SnapshotEntry& entry = snap.entries[ticket & (SNAPSHOT_SLOTS - 1)];
+            uint64_t before = entry.seq.load(std::memory_order_acquire);
+            if (before == 2 * ticket + 2) {
+                out.value = entry.value.load(std::memory_order_relaxed);
+                out.writerPid = entry.writerPid.load(std::memory_order_relaxed);
+                out.updateNs = entry.updateNs.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                found = entry.seq.load(std::memory_order_relaxed) == before;
+            }
+            if (ticket == 0) {
+                break;
+            }
+        }
+        if (!found) {
+            std::this_thread::yield(); // Все ячейки заняты писателями - почти невозможно
+        }
+    }
+    if (sd->backend == BACKEND_SHARDED) {
+        int used = sd->slotsUsed.load(std::memory_order_acquire);
+        for (int i = 0; i < used; ++i) {
+            out.value += sd->slots[i].delta.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Функция транзакции над счётчиком (режим optimistic). compute получает значение и
+// возвращает новое; она может работать сколько угодно долго - блокировка не удерживается.
+// Фиксация - один CAS самого значения: если за это время счётчик кто-то изменил, compute
+// вызывается заново. compute зависит только от значения, поэтому изменение, вернувшее то же
+// значение (ABA), на результат не влияет, и отдельная версия не нужна. Процесс, умерший
+// посреди транзакции, ничего не захватывал и никого не задерживает
+template <typename Compute>
+int64_t counter_transaction(SharedData* sd, Compute compute, uint64_t* conflicts = nullptr) {
+    std::atomic<int64_t>& counter = main_counter(sd);
+    int64_t value = counter.load(std::memory_order_acquire);
+    while (true) {
+        int64_t next = compute(value);
+        if (counter.compare_exchange_strong(value, next, std::memory_order_acq_rel)) {
+            publish_counter_snapshot(sd, cached_process_id(), HOP_TXN);
+            return next;
+        }
+        // CAS вернул текущее значение - пересчитываем от него
+        if (conflicts != nullptr) {
+            ++*conflicts;
+        }
+    }
+}
+
+// Прибавления потока, ещё не перенесённые в SharedData (режим sloppy)
+struct SloppyDelta {
+    int64_t delta = 0;
+    int ops = 0;
+    int64_t firstNs = 0;  // Время первого несброшенного прибавления
+    uint64_t flushes = 0; // Сколько раз прибавления переносились в SharedData
+};
+thread_local SloppyDelta sloppy;
+
+// Функция проверки, включён ли режим sloppy (порог в 1 прибавление - то же, что без него)
+bool sloppy_enabled(SharedData* sd) {
+    return sd->sloppyOps > 1 || sd->sloppyMs > 0;
+}
+
+// Функция изменения счётчика в SharedData выбранным способом синхронизации
+bool counter_update_shared(SharedData* sd, CounterOp op, int64_t arg, int64_t* result, bool isMaster) {
+    if (sd->backend == BACKEND_OPTIMISTIC) {
+        int64_t value = counter_transaction(sd, [&](int64_t current) {
+            return apply_counter_op(current, op, arg);
+        });
+        if (result != nullptr) {
+            *result = value;
+        }
+        return true;
+    }
+
+    if (sd->backend == BACKEND_ATOMIC) {
+        int64_t value;
+        if (op == OP_ADD) {
+            value = apply_counter_op(main_counter(sd).fetch_add(arg), OP_ADD, arg);
+        } else if (op == OP_SET) {
+            main_counter(sd).store(arg);
+            value = arg;
+        } else {
+            // Умножение и деление не имеют атомарных инструкций - CAS-цикл
+            int64_t expected = main_counter(sd).load(std::memory_order_relaxed);
+            do {
+                value = apply_counter_op(expected, op, arg);
+            } while (!main_counter(sd).compare_exchange_weak(expected, value));
+        }
+        publish_counter_snapshot(sd, cached_process_id(), op);
+        if (result != nullptr) {
+            *result = value;
+        }
+        return true;
+    }
+
+    if (sd->backend == BACKEND_SHARDED && op == OP_ADD) {
+        // Прибавления коммутативны: пишем только в свою кэш-линию
+        CounterSlot* slot = acquire_counter_slot(sd);
+        if (slot != nullptr) {
+            slot->delta.fetch_add(arg, std::memory_order_relaxed);
+            // Снимок здесь не публикуется; подписчикам о прибавлении сообщаем отдельно
+            if (sd->changeWaiters.load(std::memory_order_relaxed) > 0) {
+                publish_counter_snapshot(sd, cached_process_id(), HOP_ADD);
+            }
+            if (result != nullptr) {
+                *result = sharded_counter_sum(sd);
+            }
+            return true;
+        }
+    }
+
+    bool timed = lockTiming != nullptr || myStats != nullptr;
+    int64_t waitStart = timed ? monotonic_ns() : 0;
+    if (!acquire_mutex(sd, isMaster)) {
+        return false;
+    }
+    int64_t holdStart = timed ? monotonic_ns() : 0;
+    int64_t base = main_counter(sd).load(std::memory_order_relaxed);
+    if (sd->backend == BACKEND_SHARDED) {
+        // *, / и = не коммутируют с прибавлениями: сначала переносим все слоты в базу
+        // и применяем операцию к точному значению. Прибавления, попавшие в уже
+        // перенесённый слот во время переноса, считаются выполненными после операции
+        base = apply_counter_op(base, OP_ADD, fold_counter_slots(sd));
+    }
+    int64_t value = apply_counter_op(base, op, arg);
+    main_counter(sd).store(value, std::memory_order_relaxed);
+    publish_counter_snapshot(sd, cached_process_id(), op);
+    if (timed) {
+        int64_t holdEnd = monotonic_ns();
+        stats_record(STAT_LOCK_WAIT, holdStart - waitStart);
+        stats_record(STAT_LOCK_HOLD, holdEnd - holdStart);
+        if (lockTiming != nullptr) {
+            histogram_record(lockTiming->wait, holdStart - waitStart);
+            histogram_record(lockTiming->hold, holdEnd - holdStart);
+        }
+    }
+    release_mutex(sd, isMaster);
+    if (result != nullptr) {
+        *result = value;
+    }
+    return true;
+}
+
+// Функция чтения счётчика: снимок без блокировок, без захвата мьютекса
+bool counter_read(SharedData* sd, int64_t& result, bool isMaster) {
+    (void)isMaster;
+    CounterSnapshot snap;
+    read_counter_snapshot(sd, snap);
+    // Свои несброшенные прибавления поток видит сразу (режим sloppy)
+    result = apply_counter_op(snap.value, OP_ADD, sloppy.delta);
+    return true;
+}
+
+// Функция переноса накопленных прибавлений в SharedData одним изменением
+bool flush_sloppy_delta(SharedData* sd, bool isMaster, int64_t* result = nullptr) {
+    if (sloppy.ops == 0) {
+        return true;
+    }
+    int64_t delta = sloppy.delta;
+    sloppy.delta = 0;
+    sloppy.ops = 0;
+    sloppy.flushes++;
+    return counter_update_shared(sd, OP_ADD, delta, result, isMaster);
+}
+
+// Функция изменения счётчика, result - новое значение (если нужно). В режиме sloppy
+// прибавления сначала копятся в потоке: в SharedData уходит одно изменение на пачку.
+// *, / и = не коммутируют с прибавлениями, поэтому перед ними пачка сбрасывается
+bool counter_update(SharedData* sd, CounterOp op, int64_t arg, int64_t* result, bool isMaster) {
+    if (sloppy_enabled(sd)) {
+        if (op == OP_ADD) {
+            int64_t now = monotonic_ns();
+            if (sloppy.ops == 0) {
+                sloppy.firstNs = now;
+            }
+            sloppy.delta = apply_counter_op(sloppy.delta, OP_ADD, arg);
+            sloppy.ops++;
+            bool due = (sd->sloppyOps > 0 && sloppy.ops >= sd->sloppyOps)
+                    || (sd->sloppyMs > 0 && now - sloppy.firstNs >= sd->sloppyMs * 1000000LL);
+            if (due) {
+                return flush_sloppy_delta(sd, isMaster, result);
+            }
+            if (result != nullptr) {
+                counter_read(sd, *result, isMaster);
+            }
+            return true;
+        }
+        if (!flush_sloppy_delta(sd, isMaster)) {
+            return false;
+        }
+    }
+    return counter_update_shared(sd, op, arg, result, isMaster);
+}
+
+// Функция получения момента, к которому несброшенные прибавления потока должны уйти в
+// SharedData по порогу sloppyMs (0 - ждать нечего). Порог проверяется и при прибавлении,
+// но поток, который больше не прибавляет, сбрасывает их по таймеру цикла
+int64_t sloppy_flush_deadline(SharedData* sd) {
+    if (sd->sloppyMs <= 0 || sloppy.ops == 0) {
+        return 0;
+    }
+    return sloppy.firstNs + sd->sloppyMs * 1000000LL;
+}
+
+// Функция сброса несброшенных прибавлений, если порог sloppyMs уже прошёл
+void flush_sloppy_if_due(SharedData* sd, bool isMaster) {
+    int64_t deadlineNs = sloppy_flush_deadline(sd);
+    if (deadlineNs != 0 && monotonic_ns() >= deadlineNs) {
+        flush_sloppy_delta(sd, isMaster);
+    }
+}
+
+// Функция очистки разделяемой памяти
+void cleanup_shared_memory(SharedData* sharedData, bool isMaster) {
+    if (sharedData != nullptr && sloppy_enabled(sharedData)) {
+        flush_sloppy_delta(sharedData, isMaster); // Прибавления процесса не должны пропасть
+    }
+    release_counter_slot();
+    timeCache = nullptr;
+#ifdef __linux__
+    if (isMaster && sharedData != nullptr && sharedData != MAP_FAILED) {
+        lease_release(sharedData->lease, cached_process_id());
+    }
+#endif
+#ifdef _WIN32
+    if (sharedData != NULL) {
+        UnmapViewOfFile(sharedData);
+    }
+    // На Windows удаление именованных объектов не требуется, они удаляются автоматически
+#else
+#ifdef __linux__
+    close_shared_arena(isMaster);
+#endif
+    close_stats_segment(isMaster);
+    close_history_segment(isMaster);
+    close_persist_file();
+    if (sharedData && sharedData != MAP_FAILED) {
+        munmap(sharedData, sizeof(SharedData));
+    }
+    if (isMaster) {
+        // Мастер удаляет разделяемую память при завершении
+        if (shm_unlink(SHM_NAME) == -1) {
+            perror("[ERROR] shm_unlink");
+        } else {
+            std::cout << "[INFO] Разделяемая память удалена." << std::endl;
+        }
+    }
+#endif
+}
+
+// Функция перевода команды управляющего сокета в операцию над счётчиком
+CounterOp control_counter_op(uint32_t op) {
+    switch (op) {
+    case CTL_SET: return OP_SET;
+    case CTL_MUL: return OP_MUL;
+    case CTL_DIV: return OP_DIV;
+    default: return OP_ADD;
+    }
+}
+
+// Функция применения пачки команд за один вход в критическую секцию: results[i] - значение
+// после i-й команды. Другие процессы не видят промежуточных значений пачки ни при каком
+// способе синхронизации; команды должны быть проверены заранее
+bool counter_apply_batch(SharedData* sd, const ControlCommand* cmds, size_t count, int64_t* results, bool isMaster) {
+    auto apply = [&](int64_t value) {
+        for (size_t i = 0; i < count; ++i) {
+            if (cmds[i].op != CTL_GET) {
+                value = apply_counter_op(value, control_counter_op(cmds[i].op), cmds[i].arg);
+            }
+            results[i] = value;
+        }
+        return value;
+    };
+
+    // Пачка видит все прибавления этого процесса, как и обычная операция
+    if (!flush_sloppy_delta(sd, isMaster)) {
+        return false;
+    }
+
+    // Пачка из одних чтений обходится снимком
+    bool mutates = std::any_of(cmds, cmds + count, [](const ControlCommand& cmd) { return cmd.op != CTL_GET; });
+    if (!mutates) {
+        int64_t value;
+        counter_read(sd, value, isMaster);
+        std::fill(results, results + count, value);
+        return true;
+    }
+
+    if (sd->backend == BACKEND_OPTIMISTIC) {
+        counter_transaction(sd, apply);
+        return true;
+    }
+
+    if (sd->backend == BACKEND_ATOMIC) {
+        // Вся пачка - одно вычисление и один CAS
+        int64_t expected = main_counter(sd).load(std::memory_order_relaxed);
+        while (!main_counter(sd).compare_exchange_weak(expected, apply(expected))) {
+        }
+        publish_counter_snapshot(sd, cached_process_id(), HOP_BATCH);
+        return true;
+    }
+
+    int64_t waitStart = monotonic_ns();
+    if (!acquire_mutex(sd, isMaster)) {
+        return false;
+    }
+    int64_t holdStart = monotonic_ns();
+    int64_t base = main_counter(sd).load(std::memory_order_relaxed);
+    if (sd->backend == BACKEND_SHARDED) {
+        base = apply_counter_op(base, OP_ADD, fold_counter_slots(sd));
+    }
+    main_counter(sd).store(apply(base), std::memory_order_relaxed);
+    publish_counter_snapshot(sd, cached_process_id(), HOP_BATCH);
+    stats_record(STAT_LOCK_WAIT, holdStart - waitStart);
+    stats_record(STAT_LOCK_HOLD, monotonic_ns() - holdStart);
+    release_mutex(sd, isMaster);
+    return true;
+}
+
+// Имена лог-файлов: текстового и бинарного журнала событий
+const char* LOG_FILE = "log.txt";
+const char* LOG_BIN_FILE = "log.bin";
+
+// Ротация логов мастером: сегменты сжимаются в <имя>.<время>.gz, хранятся последние keep.
+// Место на диске ограничено примерно (keep + 1) * maxBytes до сжатия (при сборке с HW3_NO_ZLIB
+// сегменты остаются несжатыми)
+struct LogRotation {
+    int64_t maxBytes = 4 << 20; // 0 - без ротации по размеру
+    int intervalSec = 3600;     // 0 - без ротации по времени
+    int keep = 5;
+};
+LogRotation logRotation;
+
+// Функция записи в лог-файл напрямую под межпроцессным мьютексом
+void write_log_direct(SharedData* sd, const std::string& msg, bool isMaster) {
+    if (!acquire_mutex(sd, isMaster)) {
+        std::cerr << "[ERROR] Не удалось захватить мьютекс для записи в лог." << std::endl;
+        return;
+    }
+    {
+        int64_t start = monotonic_ns();
+        std::ofstream logFile(LOG_FILE, std::ios::app);
+        if (logFile.is_open()) {
+            logFile << msg << std::endl;
+            logFile.close();
+        } else {
+            std::cerr << "[ERROR] Не удалось открыть log.txt для записи." << std::endl;
+        }
+        stats_record(STAT_LOG_WRITE, monotonic_ns() - start);
+    }
+    release_mutex(sd, isMaster);
+}
+
+#ifndef _WIN32
+// Функция помещения строки в кольцевой буфер (без системных вызовов и блокировок)
+bool log_ring_push(LogRing& ring, const std::string& msg) {
+    uint64_t pos;
+    RingCell<LogLine>* cell = ring_reserve(ring.lines, pos);
+    if (cell == nullptr) {
+        return false; // Буфер заполнен, мастер не успевает
+    }
+
+    // Обрезаем слишком длинные строки, не разрывая UTF-8 символ
+    size_t len = std::min(msg.size(), LOG_RECORD_TEXT - 1);
+    if (len < msg.size()) {
+        while (len > 0 && (static_cast<unsigned char>(msg[len]) & 0xC0) == 0x80) {
+            --len;
+        }
+    }
+    std::memcpy(cell->item.text, msg.data(), len);
+    cell->item.text[len] = '\n';
+    cell->item.len = static_cast<uint32_t>(len + 1);
+    ring_publish(cell, pos);
+    return true;
+}
+
+// Функция сигнала потоку мастера о новой записи. Пока поток мастера не спит, это одна
+// загрузка; уснувшего будит только первый писатель, снявший флаг drainerSleeping
+void notify_log_ring(LogRing& ring) {
+#ifdef __linux__
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Запись в кольцо - до проверки флага
+    if (ring.drainerSleeping.load(std::memory_order_relaxed) != 0 && ring.drainerSleeping.exchange(0) != 0) {
+        ring.pushes.fetch_add(1, std::memory_order_release);
+        futex_wake(&ring.pushes, 1);
+    }
+#else
+    (void)ring;
+#endif
+}
+
+// Функция ожидания новых записей не дольше timeoutNs. Флаг ставится до повторной проверки
+// кольца: запись, не попавшая в проверку, увидит флаг и разбудит. false - ждать не пришлось
+template <typename Recheck>
+bool wait_log_ring(LogRing& ring, int64_t timeoutNs, Recheck recheck) {
+#ifdef __linux__
+    uint32_t pushes = ring.pushes.load(std::memory_order_acquire);
+    ring.drainerSleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (recheck() > 0) {
+        ring.drainerSleeping.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    struct timespec timeout = { static_cast<time_t>(timeoutNs / 1000000000), static_cast<long>(timeoutNs % 1000000000) };
+    futex_wait(&ring.pushes, pushes, &timeout);
+    ring.drainerSleeping.store(0, std::memory_order_relaxed);
+#else
+    (void)ring;
+    (void)recheck;
+    sleep_ms(static_cast<int>(std::min<int64_t>(timeoutNs / 1000000, 20))); // Без futex - опрос, как раньше
+#endif
+    return true;
+}
+
+// Функция записи всех буферов iov, дописывает остаток, если writev записал не всё
+void write_all_iov(int fd, struct iovec* iov, int count) {
+    int64_t start = monotonic_ns();
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[ERROR] writev");
+            break;
+        }
+        while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    stats_record(STAT_LOG_WRITE, monotonic_ns() - start);
+}
+
+// Функция вычитывания готовых записей пачками через writev, возвращает число записей.
+// to_iov описывает байты записи, которые попадают в файл
+template <typename T, uint64_t Capacity, typename ToIov>
+size_t drain_ring_to_fd(SharedRing<T, Capacity>& ring, int fd, ToIov to_iov) {
+    const int BATCH = std::min(IOV_MAX, 256);
+    size_t total = 0;
+    while (true) {
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        struct iovec iov[BATCH];
+        int count = 0;
+        while (count < BATCH) {
+            RingCell<T>* cell = ring_peek(ring, tail + count);
+            if (cell == nullptr) {
+                break; // Запись ещё не готова - сохраняем порядок резервирования
+            }
+            iov[count] = to_iov(cell->item);
+            ++count;
+        }
+        if (count == 0) {
+            int32_t owner = ring_abandoned(ring, tail);
+            if (owner == 0) {
+                return total;
+            }
+            // Писатель завершился посреди записи: без пропуска вычитывание встало бы навсегда
+            std::cerr << "[WARN] Пропущена лог-запись: процесс " << owner
+                      << " завершился, не дописав её." << std::endl;
+            ring.cells[tail & (Capacity - 1)].owner.store(0, std::memory_order_relaxed);
+            ring_consume(ring, 1);
+            continue;
+        }
+        write_all_iov(fd, iov, count);
+        ring_consume(ring, count);
+        total += count;
+    }
+}
+
+// Функция вычитывания текстовых записей в log.txt
+size_t drain_log_lines(LogRing& ring, int fd) {
+    return drain_ring_to_fd(ring.lines, fd, [](LogLine& line) {
+        struct iovec iov = { line.text, line.len };
+        return iov;
+    });
+}
+
+// Функция вычитывания бинарных событий в log.bin
+size_t drain_log_events(LogRing& ring, int fd) {
+    return drain_ring_to_fd(ring.events, fd, [](EventRecord& ev) {
+        struct iovec iov = { &ev, sizeof(EventRecord) };
+        return iov;
+    });
+}
+
+// Функция открытия log.bin на дозапись; новый файл начинается с заголовка
+int open_event_log() {
+    int fd = open(LOG_BIN_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("[ERROR] open log.bin");
+        return -1;
+    }
+    if (lseek(fd, 0, SEEK_END) == 0 && write(fd, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC)) < 0) {
+        perror("[ERROR] write log.bin");
+    }
+    return fd;
+}
+
+// Активный лог-файл: его держит открытым поток вычитывания, поэтому ротация не
+// останавливает писателей - они продолжают класть записи в кольцевой буфер
+struct ActiveLog {
+    const char* path;
+    bool binary;          // log.bin: новый файл начинается с заголовка
+    int fd = -1;
+    int64_t openedNs = 0; // Возраст файла для ротации по времени
+};
+
+// Функция открытия активного лог-файла на дозапись
+bool open_active_log(ActiveLog& log) {
+    log.fd = log.binary ? open_event_log() : open(log.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log.fd < 0) {
+        if (!log.binary) {
+            perror("[ERROR] open log.txt");
+        }
+        return false;
+    }
+    log.openedNs = monotonic_ns();
+    return true;
+}
+
+// Очередь сегментов на сжатие и поток с низким приоритетом, который её разбирает
+struct LogCompressor {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> queue;
+    bool running = false;
+};
+LogCompressor logCompressor;
+
+// Функция сжатия сегмента в <path>.gz; исходный файл удаляется только после успешного сжатия
+bool compress_log_segment(const std::string& path) {
+#ifdef HW3_NO_ZLIB
+    (void)path;
+    return true; // Собрано без zlib: сегмент остаётся как есть
+#else
+    std::string tmp = path + ".gz.tmp";
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        perror(("[ERROR] open " + path).c_str());
+        return false;
+    }
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    if (out == NULL) {
+        std::cerr << "[ERROR] Не удалось создать " << tmp << std::endl;
+        close(in);
+        return false;
+    }
+    static char buffer[1 << 16];
+    bool ok = true;
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        if (gzwrite(out, buffer, static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    close(in);
+    if (gzclose(out) != Z_OK || n < 0 || !ok || rename(tmp.c_str(), (path + ".gz").c_str()) == -1) {
+        std::cerr << "[ERROR] Не удалось сжать " << path << std::endl;
+        unlink(tmp.c_str());
+        return false;
+    }
+    unlink(path.c_str());
+    return true;
+#endif
+}
+
+// Функция удаления старых сегментов лога сверх keep. Имена сегментов - <имя>.<время>[-N][.gz],
+// поэтому порядок имён совпадает с порядком ротаций
+void prune_log_segments(const char* logPath, int keep) {
+    std::string path = logPath;
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    std::string prefix = (slash == std::string::npos ? path : path.substr(slash + 1)) + ".";
+
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) {
+        return;
+    }
+    std::vector<std::string> segments;
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        bool tmp = name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+        if (name.compare(0, prefix.size(), prefix) == 0 && name.size() > prefix.size()
+            && std::isdigit(static_cast<unsigned char>(name[prefix.size()])) && !tmp) {
+            segments.push_back(name);
+        }
+    }
+    closedir(d);
+
+    std::sort(segments.begin(), segments.end());
+    for (size_t i = 0; i + keep < segments.size(); ++i) {
+        std::string victim = (slash == std::string::npos ? "" : dir) + segments[i];
+        if (unlink(victim.c_str()) == -1) {
+            perror(("[ERROR] unlink " + victim).c_str());
+        }
+    }
+}
+
+// Функция потока сжатия. SCHED_IDLE: поток получает процессор, только когда он никому не нужен
+void log_compressor_thread_func() {
+#ifdef __linux__
+    struct sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    std::unique_lock<std::mutex> lock(logCompressor.mutex);
+    while (true) {
+        logCompressor.wake.wait(lock, []() { return !logCompressor.queue.empty() || !logCompressor.running; });
+        if (logCompressor.queue.empty()) {
+            break; // Остановка, и всё уже сжато
+        }
+        std::string path = logCompressor.queue.front();
+        logCompressor.queue.pop_front();
+        lock.unlock();
+        compress_log_segment(path);
+        // Сегмент только что переименован из активного файла - отрезаем от его имени суффикс
+        size_t dot = path.rfind('.');
+        prune_log_segments(path.substr(0, dot).c_str(), logRotation.keep);
+        lock.lock();
+    }
+}
+
+// Функция постановки сегмента в очередь на сжатие
+void queue_log_compression(const std::string& path) {
+    std::lock_guard<std::mutex> lock(logCompressor.mutex);
+    logCompressor.queue.push_back(path);
+    logCompressor.wake.notify_one();
+}
+
+// Функция ротации: активный файл переименовывается (tail -F перейдёт на новый), поток
+// вычитывания открывает новый, а старый уходит на сжатие
+bool rotate_active_log(ActiveLog& log) {
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_now);
+    std::string target = std::string(log.path) + "." + stamp;
+    struct stat st;
+    for (int n = 1; stat(target.c_str(), &st) == 0 || stat((target + ".gz").c_str(), &st) == 0; ++n) {
+        target = std::string(log.path) + "." + stamp + "-" + std::to_string(n);
+    }
+
+    if (rename(log.path, target.c_str()) == -1) {
+        perror("[ERROR] rename log");
+        log.openedNs = monotonic_ns(); // Следующая попытка - через полный период
+        return false;
+    }
+    int oldFd = log.fd;
+    if (!open_active_log(log)) {
+        log.fd = oldFd; // Продолжаем писать в переименованный файл, лишь бы не терять записи
+        return false;
+    }
+    close(oldFd);
+    queue_log_compression(target);
+    return true;
+}
+
+// Функция проверки, не пора ли ротировать активный файл по размеру или возрасту
+void rotate_log_if_needed(ActiveLog& log) {
+    struct stat st;
+    if (log.fd < 0 || fstat(log.fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+    off_t empty = log.binary ? sizeof(EVENT_LOG_MAGIC) : 0;
+    if (st.st_size <= empty) {
+        return; // Пустой файл не ротируем даже по времени
+    }
+    bool bySize = logRotation.maxBytes > 0 && st.st_size >= logRotation.maxBytes;
+    bool byAge = logRotation.intervalSec > 0
+              && monotonic_ns() - log.openedNs >= logRotation.intervalSec * 1000000000LL;
+    if (bySize || byAge) {
+        rotate_active_log(log);
+    }
+}
+
+// Состояние потока мастера, переносящего записи из буфера в log.txt и log.bin
+std::thread logDrainerThread;
+std::atomic<bool> logDrainerRunning(false);
+LogRing* logDrainerRing = nullptr; // Кольцо, на котором ждёт поток: его будит остановка
+
+// Функция потока вычитывания лог-записей
+void log_drainer_thread_func(SharedData* sd) {
+    ActiveLog text = { LOG_FILE, false };
+    if (!open_active_log(text)) {
+        return;
+    }
+    ActiveLog bin = { LOG_BIN_FILE, true };
+    if (sd->binaryLog) {
+        open_active_log(bin);
+    }
+    auto drain = [&]() {
+        size_t drained = drain_log_lines(sd->logRing, text.fd);
+        if (bin.fd >= 0) {
+            drained += drain_log_events(sd->logRing, bin.fd);
+        }
+        return drained;
+    };
+    // Этот же поток делает контрольные точки файла сохранения: msync не задерживает цикл событий
+    int64_t nextCheckpointNs = monotonic_ns();
+    auto checkpoint = [&]() {
+        if (persistFile != nullptr) {
+            uint64_t seq = persistFile->walSeq.load();
+            CounterSnapshot snap;
+            read_counter_snapshot(sd, snap);
+            persist_checkpoint(snap.value, seq);
+        }
+        nextCheckpointNs = monotonic_ns() + PERSIST_CHECKPOINT_MS * 1000000LL;
+    };
+    while (logDrainerRunning) {
+        if (monotonic_ns() >= nextCheckpointNs) {
+            checkpoint();
+        }
+        size_t drained = drain();
+        rotate_log_if_needed(text);
+        rotate_log_if_needed(bin);
+        if (drained == 0) {
+            // Спим до новой записи; контрольная точка и ротация по возрасту - по таймауту
+            int64_t timeoutNs = std::min<int64_t>(nextCheckpointNs - monotonic_ns(), 1000000000LL);
+            wait_log_ring(sd->logRing, std::max<int64_t>(timeoutNs, 1000000), [&]() {
+                return logDrainerRunning ? drain() : 1; // Остановка тоже не даёт уснуть
+            });
+        }
+    }
+    drain(); // Дописываем то, что успели положить перед остановкой
+    checkpoint();
+    if (bin.fd >= 0) {
+        close(bin.fd);
+    }
+    close(text.fd);
+}
+#endif
+
+// Функция запуска вычитывания лог-записей (только мастер)
+void start_log_drainer(SharedData* sd, bool isMaster) {
+#ifndef _WIN32
+    if (isMaster && !logDrainerRunning) {
+        logCompressor.running = true;
+        logCompressor.thread = std::thread(log_compressor_thread_func);
+        logDrainerRunning = true;
+        logDrainerRing = &sd->logRing;
+        logDrainerThread = std::thread(log_drainer_thread_func, sd);
+    }
+#endif
+}
+
+// Функция остановки вычитывания лог-записей
+void stop_log_drainer() {
+#ifndef _WIN32
+    if (logDrainerRunning) {
+        logDrainerRunning = false;
+        logDrainerRing->drainerSleeping.store(1); // Будим поток, даже если он только собирается уснуть
+        notify_log_ring(*logDrainerRing);
+        logDrainerThread.join();
+        // Сегменты, ротированные перед остановкой, дожимаем до выхода
+        {
+            std::lock_guard<std::mutex> lock(logCompressor.mutex);
+            logCompressor.running = false;
+            logCompressor.wake.notify_one();
+        }
+        logCompressor.thread.join();
+    }
+#endif
+}
+
+// Функция записи в лог-файл: через кольцевой буфер, при переполнении - напрямую
+void write_log(SharedData* sd, const std::string& msg, bool isMaster) {
+#ifndef _WIN32
+    if (log_ring_push(sd->logRing, msg)) {
+        notify_log_ring(sd->logRing);
+        return;
+    }
+    sd->logRing.overflows.fetch_add(1, std::memory_order_relaxed);
+#endif
+    write_log_direct(sd, msg, isMaster);
+}
+
+// Функция записи события. В бинарном режиме в журнал уходит запись фиксированного
+// размера без форматирования; в текстовом - та же строка, что потом рисует decode_log
+void emit_event(SharedData* sd, EventKind kind, int64_t value, int64_t aux, bool isMaster, uint16_t code = 0) {
+    EventRecord ev;
+    ev.timeNs = realtime_ns();
+    ev.pid = cached_process_id();
+    ev.kind = kind;
+    ev.code = code;
+    ev.value = value;
+    ev.aux = aux;
+#ifndef _WIN32
+    if (sd->binaryLog) {
+        if (ring_push(sd->logRing.events, ev)) {
+            notify_log_ring(sd->logRing);
+            return;
+        }
+        // Кольцо заполнено: одна запись с O_APPEND дописывается атомарно и без мьютекса
+        sd->logRing.overflows.fetch_add(1, std::memory_order_relaxed);
+        int fd = open(LOG_BIN_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) {
+            if (write(fd, &ev, sizeof(ev)) < 0) {
+                perror("[ERROR] write log.bin");
+            }
+            close(fd);
+        }
+        return;
+    }
+#endif
+    write_log(sd, format_event(ev, cached_format_time), isMaster);
+}
+
+// Функция записи события уровня Level. Уровни ниже HW3_LOG_LEVEL отсекаются при компиляции,
+// остальные - сравнением с порогом мастера до того, как что-либо будет сформировано
+template <LogLevel Level>
+inline void log_event(SharedData* sd, EventKind kind, int64_t value, int64_t aux, bool isMaster, uint16_t code = 0) {
+    if (Level < HW3_LOG_LEVEL) {
+        return;
+    }
+    if (Level < sd->logLevel.load(std::memory_order_relaxed)) {
+        return;
+    }
+    emit_event(sd, kind, value, aux, isMaster, code);
+}
+
+#ifndef _WIN32
+// Функция порождения процесса fork + exec, возвращает PID или -1
+pid_t fork_exec(const std::vector<std::string>& args_vec, bool dieWithParent = false) {
+    std::vector<char*> args;
+    for (const auto& arg : args_vec) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(NULL);
+
+    int64_t start = monotonic_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("[ERROR] fork");
+        return -1;
+    }
+    if (pid == 0) {
+        // Дочерний процесс: маска сигналов цикла событий наследуется через exec, сбрасываем её
+        sigset_t empty;
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+#ifdef __linux__
+        if (dieWithParent) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+        }
+#endif
+        execvp(args[0], args.data());
+        // Если exec не удался
+        perror("[ERROR] execvp");
+        exit(EXIT_FAILURE);
+    }
+    // Родительский процесс
+    stats_record(STAT_SPAWN, monotonic_ns() - start);
+    return pid;
+}
+#endif
+
+// Запущенная копия: по дескриптору мастер узнаёт именно о её завершении
+struct ChildHandle {
+#ifdef _WIN32
+    HANDLE process = NULL;
+#else
+    pid_t pid = -1;
+    int pidfd = -1; // Linux: читаем в epoll после завершения; -1 - ядро без pidfd_open
+#endif
+    int mode = 0;
+    int64_t startNs = 0;
+};
+
+// Функция проверки, что копия была запущена
+bool child_started(const ChildHandle& child) {
+#ifdef _WIN32
+    return child.process != NULL;
+#else
+    return child.pid > 0;
+#endif
+}
+
+// Функция запуска копии программы
+ChildHandle spawn_copy(int mode, const std::string& exePath, int holdMs = 2000) {
+    ChildHandle child;
+    child.mode = mode;
+    child.startNs = monotonic_ns();
+    std::vector<std::string> args_vec = { exePath, "--child", std::to_string(mode) };
+    if (holdMs != 2000) {
+        args_vec.push_back("--hold");
+        args_vec.push_back(std::to_string(holdMs));
+    }
+
+#ifdef _WIN32
+    // Формируем командную строку
+    std::string cmdLine;
+    for (const auto& arg : args_vec) {
+        cmdLine += arg;
+        cmdLine += " ";
+    }
+
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    ZeroMemory(&pi, sizeof(pi));
+
+    BOOL success = CreateProcessA(
+        NULL,
+        const_cast<char*>(cmdLine.c_str()),
+        NULL,
+        NULL,
+        FALSE,
+        0,
+        NULL,
+        NULL,
+        &si,
+        &pi
+    );
+
+    if (!success) {
+        std::cerr << "[ERROR] CreateProcess failed with error: " << GetLastError() << std::endl;
+        return child;
+    }
+
+    // Дескриптор процесса оставляем: по нему мастер узнает о завершении
+    CloseHandle(pi.hThread);
+    child.process = pi.hProcess;
+#else
+    child.pid = fork_exec(args_vec);
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    // PID не может быть переиспользован, пока копия не собрана, поэтому гонки с fork нет
+    if (child.pid > 0) {
+        child.pidfd = static_cast<int>(syscall(SYS_pidfd_open, child.pid, 0));
+    }
+#endif
+#endif
+    return child;
+}
+
+// Функция для режима копии 1
+void run_copy_mode1(SharedData* sd, bool isMaster) {
+    log_event<LEVEL_INFO>(sd, EV_COPY1_START, 0, 0, isMaster);
+
+    // Увеличиваем счётчик на 10; копия сразу завершается, копить прибавление незачем
+    counter_update(sd, OP_ADD, 10, nullptr, isMaster);
+    flush_sloppy_delta(sd, isMaster);
+
+    // Записываем время завершения и значение счётчика из согласованного снимка
+    CounterSnapshot snap;
+    read_counter_snapshot(sd, snap);
+    log_event<LEVEL_INFO>(sd, EV_COPY1_END, snap.value, 0, isMaster);
+}
+
+// Функция для режима копии 2
+void run_copy_mode2(SharedData* sd, bool isMaster, int holdMs = 2000) {
+    log_event<LEVEL_INFO>(sd, EV_COPY2_START, 0, 0, isMaster);
+
+    if (sd->backend == BACKEND_OPTIMISTIC) {
+        // Удвоение и деление пополам - две транзакции, как *2 и /2 в остальных режимах
+        counter_transaction(sd, [](int64_t current) {
+            return apply_counter_op(current, OP_MUL, 2);
+        });
+        sleep_ms(holdMs);
+        counter_transaction(sd, [](int64_t current) {
+            return apply_counter_op(current, OP_DIV, 2);
+        });
+    }
+    else {
+        // Умножаем счётчик на 2
+        counter_update(sd, OP_MUL, 2, nullptr, isMaster);
+
+        // Ждём 2 секунды
+        sleep_ms(holdMs);
+
+        // Делим счётчик на 2
+        counter_update(sd, OP_DIV, 2, nullptr, isMaster);
+    }
+
+    // Записываем время завершения и значение счётчика из согласованного снимка
+    CounterSnapshot snap;
+    read_counter_snapshot(sd, snap);
+    log_event<LEVEL_INFO>(sd, EV_COPY2_END, snap.value, 0, isMaster);
+}
+
+#ifdef __linux__
+// Функция постановки задания в очередь
+bool job_queue_push(JobQueue& queue, int mode, int holdMs) {
+    Job job;
+    job.mode = mode;
+    job.holdMs = holdMs;
+    job.submitNs = monotonic_ns();
+    if (!ring_push(queue.jobs, job)) {
+        return false; // Очередь заполнена
+    }
+
+    // Будим воркера, только если кто-то спит: без спящих постановка обходится без syscall
+    queue.futexWord.fetch_add(1);
+    if (queue.sleepers.load() > 0) {
+        futex_wake(&queue.futexWord, 1);
+    }
+    return true;
+}
+
+// Функция извлечения задания из очереди
+bool job_queue_pop(JobQueue& queue, int& mode, int& holdMs, int64_t& submitNs) {
+    Job job;
+    if (!ring_pop(queue.jobs, job)) {
+        return false; // Очередь пуста
+    }
+    mode = job.mode;
+    holdMs = job.holdMs;
+    submitNs = job.submitNs;
+    return true;
+}
+#endif
+
+// Функция выполнения задания копии; submitNs > 0 - учитывать задержки в статистике
+void run_job(SharedData* sd, int mode, int holdMs, int64_t submitNs, bool isMaster) {
+    int64_t startNs = monotonic_ns();
+    if (mode == 1) {
+        run_copy_mode1(sd, isMaster);
+    }
+    else if (mode == 2) {
+        run_copy_mode2(sd, isMaster, holdMs);
+    }
+    else {
+        return;
+    }
+
+#ifdef __linux__
+    if (submitNs > 0) {
+        JobStats& stats = sd->jobQueue.stats[mode];
+        uint64_t dispatch = static_cast<uint64_t>(startNs - submitNs);
+        stats.dispatchSumNs.fetch_add(dispatch, std::memory_order_relaxed);
+        uint64_t prevMax = stats.dispatchMaxNs.load(std::memory_order_relaxed);
+        while (dispatch > prevMax && !stats.dispatchMaxNs.compare_exchange_weak(prevMax, dispatch)) {
+        }
+        stats.totalSumNs.fetch_add(static_cast<uint64_t>(monotonic_ns() - submitNs), std::memory_order_relaxed);
+        stats.completed.fetch_add(1, std::memory_order_release);
+    }
+#else
+    (void)startNs;
+    (void)submitNs;
+#endif
+}
+
+#ifdef __linux__
+// Функция основного цикла воркера пула: спит на futex, пока нет заданий
+void run_pool_worker(SharedData* sd) {
+    JobQueue& queue = sd->jobQueue;
+    while (queue.shutdown.load() == 0) {
+        int mode, holdMs;
+        int64_t submitNs;
+        uint32_t seen = queue.futexWord.load();
+        if (job_queue_pop(queue, mode, holdMs, submitNs)) {
+            run_job(sd, mode, holdMs, submitNs, false);
+            continue;
+        }
+        // Если после чтения seen кто-то поставил задание, futex_wait сразу вернётся
+        queue.sleepers.fetch_add(1);
+        if (queue.shutdown.load() == 0) {
+            futex_wait(&queue.futexWord, seen, NULL);
+        }
+        queue.sleepers.fetch_sub(1);
+    }
+}
+
+// Пул долгоживущих воркеров мастера
+struct WorkerPool {
+    std::vector<pid_t> workers;
+    std::string exePath;
+};
+WorkerPool workerPool;
+
+// Функция запуска одного воркера; воркер получит SIGTERM, если мастер умрёт
+pid_t spawn_worker(const std::string& exePath) {
+    return fork_exec({ exePath, "--worker" }, true);
+}
+
+// Функция запуска пула воркеров
+bool start_worker_pool(SharedData* sd, const std::string& exePath, int size) {
+    sd->jobQueue.shutdown.store(0);
+    workerPool.exePath = exePath;
+    for (int i = 0; i < size; ++i) {
+        pid_t worker = spawn_worker(exePath);
+        if (worker < 0) {
+            return false;
+        }
+        workerPool.workers.push_back(worker);
+    }
+    return true;
+}
+
+// Функция остановки пула воркеров
+void stop_worker_pool(SharedData* sd) {
+    if (workerPool.workers.empty()) {
+        return;
+    }
+    sd->jobQueue.shutdown.store(1);
+    sd->jobQueue.futexWord.fetch_add(1);
+    futex_wake(&sd->jobQueue.futexWord, INT_MAX);
+    for (pid_t worker : workerPool.workers) {
+        int status;
+        if (worker > 0) {
+            waitpid(worker, &status, 0);
+        }
+    }
+    workerPool.workers.clear();
+}
+
+// Функция перезапуска завершившихся воркеров
+void reap_workers(SharedData* sd, bool isMaster) {
+    for (pid_t& worker : workerPool.workers) {
+        int status;
+        if (worker > 0 && waitpid(worker, &status, WNOHANG) == worker) {
+            pid_t old = worker;
+            worker = spawn_worker(workerPool.exePath);
+            log_event<LEVEL_WARN>(sd, EV_MASTER_WORKER_RESTARTED, old, worker, isMaster);
+        }
+    }
+}
+#endif
+
+// Функция установки значения счётчика, введённого пользователем
+void apply_user_value(SharedData* sd, int64_t new_value, bool isMaster) {
+    // Устанавливаем новое значение счётчика
+    counter_update(sd, OP_SET, new_value, nullptr, isMaster);
+
+    // Записываем изменение в лог
+    log_event<LEVEL_INFO>(sd, EV_USER_SET, new_value, 0, isMaster);
+}
+
+// Функция для обработки пользовательского ввода
+void user_input_thread_func(SharedData* sd, std::atomic<bool>& running, bool isMaster) {
+    while (running) {
+        std::cout << "Введите новое значение счётчика: ";
+        int new_value;
+        std::cin >> new_value;
+        if (std::cin.fail()) {
+            std::cin.clear(); // Сброс состояния ошибки
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Игнорирование некорректного ввода
+            std::cout << "Некорректный ввод. Пожалуйста, введите целое число." << std::endl;
+            continue;
+        }
+        apply_user_value(sd, new_value, isMaster);
+    }
+}
+
+// Функция получения названия способа синхронизации
+const char* backend_name(int backend) {
+    switch (backend) {
+    case BACKEND_MUTEX: return "mutex";
+    case BACKEND_ATOMIC: return "atomic";
+    case BACKEND_SHARDED: return "sharded";
+    case BACKEND_FUTEX: return "futex";
+    case BACKEND_OPTIMISTIC: return "optimistic";
+    }
+    return "unknown";
+}
+
+// Функция разбора названия уровня лога
+bool parse_log_level(const char* name, LogLevel& level) {
+    static const char* const names[] = { "debug", "info", "warn", "error" };
+    for (int l = LEVEL_DEBUG; l <= LEVEL_ERROR; ++l) {
+        if (std::strcmp(name, names[l]) == 0) {
+            level = static_cast<LogLevel>(l);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Функция разбора названия способа синхронизации
+bool parse_backend(const char* name, CounterBackend& backend) {
+    for (int b = BACKEND_MUTEX; b <= BACKEND_OPTIMISTIC; ++b) {
+        if (std::strcmp(name, backend_name(b)) == 0) {
+            backend = static_cast<CounterBackend>(b);
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifndef _WIN32
+// Функция запуска procs процессов с общим стартом, возвращает время работы в секундах
+double run_forked_round(int procs, const std::function<void(int)>& worker) {
+    // Флаг старта в анонимной разделяемой памяти, чтобы fork() не попал в замер
+    std::atomic<int>* go = static_cast<std::atomic<int>*>(mmap(NULL, sizeof(std::atomic<int>),
+                                                               PROT_READ | PROT_WRITE,
+                                                               MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (go == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        return -1.0;
+    }
+    go->store(0);
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < procs; ++i) {
+        pid_t child = fork();
+        if (child < 0) {
+            perror("[ERROR] fork");
+            break;
+        }
+        if (child == 0) {
+            while (go->load(std::memory_order_acquire) == 0) {
+                std::this_thread::yield();
+            }
+            worker(i);
+            _exit(EXIT_SUCCESS);
+        }
+        children.push_back(child);
+    }
+
+    int64_t start = monotonic_ns();
+    go->store(1, std::memory_order_release);
+    for (pid_t child : children) {
+        int status;
+        waitpid(child, &status, 0);
+    }
+    int64_t elapsed = monotonic_ns() - start;
+
+    munmap(go, sizeof(std::atomic<int>));
+    if (static_cast<int>(children.size()) != procs) {
+        return -1.0;
+    }
+    return elapsed / 1e9;
+}
+#endif
+
+// Функция запуска threads потоков этого процесса с общим стартом, возвращает время работы
+// в секундах. Пара к run_forked_round: тот же worker, но общее адресное пространство
+double run_threaded_round(int threads, const std::function<void(int)>& worker) {
+    std::atomic<int> go{0};
+    std::vector<std::thread> pool;
+    try {
+        for (int i = 0; i < threads; ++i) {
+            pool.emplace_back([&go, &worker, i]() {
+                while (go.load(std::memory_order_acquire) == 0) {
+                    std::this_thread::yield();
+                }
+                worker(i);
+            });
+        }
+    } catch (const std::system_error& e) {
+        std::cerr << "[ERROR] std::thread: " << e.what() << std::endl;
+    }
+
+    int64_t start = monotonic_ns();
+    go.store(1, std::memory_order_release);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    int64_t elapsed = monotonic_ns() - start;
+
+    if (static_cast<int>(pool.size()) != threads) {
+        return -1.0;
+    }
+    return elapsed / 1e9;
+}
+
+#ifndef _WIN32
+// Функция переключения на отдельный сегмент и лог, чтобы не мешать работающему мастеру.
+// Через окружение настройки наследуют и порождённые exec процессы
+void use_bench_segment() {
+    SHM_NAME = "/mysharedmemory_bench";
+    LOG_FILE = "/dev/null";
+    LOG_BIN_FILE = "/dev/null";
+    setenv("HW3_SHM_NAME", SHM_NAME, 1);
+    setenv("HW3_LOG_FILE", LOG_FILE, 1);
+    setenv("HW3_LOG_BIN_FILE", LOG_BIN_FILE, 1);
+    shm_unlink(SHM_NAME);
+}
+#endif
+
+// Веса операций в смеси бенчмарка
+enum BenchOp : int {
+    BENCH_ADD1 = 0,   // +1, как таймер 300 мс
+    BENCH_ADD10 = 1,  // +10, как копия 1
+    BENCH_MULDIV = 2, // *2, затем /2, как копия 2 (две операции)
+    BENCH_SET = 3,    // =, как ввод пользователя
+    BENCH_OP_COUNT = 4
+};
+const char* BENCH_OP_NAMES[BENCH_OP_COUNT] = { "add1", "add10", "muldiv", "set" };
+
+// Функция разбора смеси вида "add1:50,add10:20,muldiv:20,set:10"
+bool parse_bench_mix(const char* spec, int weights[BENCH_OP_COUNT]) {
+    for (int op = 0; op < BENCH_OP_COUNT; ++op) {
+        weights[op] = 0;
+    }
+    std::string text(spec);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        int weight = colon == std::string::npos ? 1 : std::atoi(item.c_str() + colon + 1);
+        int op = 0;
+        while (op < BENCH_OP_COUNT && name != BENCH_OP_NAMES[op]) {
+            ++op;
+        }
+        if (op == BENCH_OP_COUNT || weight < 0) {
+            return false;
+        }
+        weights[op] = weight;
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    int sum = 0;
+    for (int op = 0; op < BENCH_OP_COUNT; ++op) {
+        sum += weights[op];
+    }
+    return sum > 0;
+}
+
+#ifndef _WIN32
+// Результаты одного процесса бенчмарка (в анонимной разделяемой памяти)
+struct BenchProcResult {
+    LatencyHistogram op;
+    LockTiming lock;
+    uint64_t ops;
+    uint64_t contextSwitches;
+};
+
+// Функция получения числа переключений контекста этого потока (вне Linux - процесса)
+uint64_t context_switches() {
+    struct rusage usage;
+#ifdef __linux__
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    return static_cast<uint64_t>(usage.ru_nvcsw + usage.ru_nivcsw);
+}
+#endif
+
+// Функция нагрузочного сравнения способов синхронизации счётчика: N процессов
+// выполняют смесь операций, печатаются пропускная способность, перцентили задержек
+// операции, ожидания и удержания блокировки и переключения контекста на операцию.
+// compareThreads - каждую строку повторить потоками одного процесса (--bench-topology)
+int run_counter_benchmark(int maxProcs, int opsPerProc, const int weights[BENCH_OP_COUNT], bool compareThreads = false) {
+#ifdef _WIN32
+    (void)maxProcs;
+    (void)opsPerProc;
+    (void)weights;
+    (void)compareThreads;
+    std::cerr << "[ERROR] Режим сравнения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    size_t resultsSize = sizeof(BenchProcResult) * maxProcs;
+    BenchProcResult* results = static_cast<BenchProcResult*>(mmap(NULL, resultsSize,
+                                                                  PROT_READ | PROT_WRITE,
+                                                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (results == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+
+    // Расписание операций: каждая операция встречается пропорционально своему весу
+    std::vector<int> schedule;
+    for (int op = 0; op < BENCH_OP_COUNT; ++op) {
+        schedule.insert(schedule.end(), weights[op], op);
+    }
+
+    std::string mix;
+    for (int op = 0; op < BENCH_OP_COUNT; ++op) {
+        if (weights[op] > 0) {
+            mix += (mix.empty() ? "" : ",") + std::string(BENCH_OP_NAMES[op]) + ":" + std::to_string(weights[op]);
+        }
+    }
+    std::cout << "mix=" << mix << ", ops/proc=" << opsPerProc
+              << ", latencies in ns (p50/p99/p999), wait/hold - only where a lock is taken" << std::endl;
+    std::cout << "backend    topo    procs        ops/s   op p50/p99/p999        wait p50/p99/p999      hold p50/p99/p999      cs/op" << std::endl;
+
+    for (int backend = BACKEND_MUTEX; backend <= BACKEND_OPTIMISTIC; ++backend) {
+        for (int procs = 1; ; procs = std::min(procs * 2, maxProcs)) {
+            for (int threaded = 0; threaded <= (compareThreads ? 1 : 0); ++threaded) {
+                sd->backend = backend;
+                main_counter(sd).store(0);
+                for (CounterSlot& slot : sd->slots) {
+                    slot.delta.store(0);
+                }
+#ifdef __linux__
+                shm_lock_init(sd->lock);
+#endif
+                std::memset(static_cast<void*>(results), 0, resultsSize);
+
+                // Одинаковая работа для процесса и для потока: слот счётчика и замеры у каждого свои
+                auto worker = [&](int index) {
+                    BenchProcResult& result = results[index];
+                    lockTiming = &result.lock;
+                    uint64_t switchesBefore = context_switches();
+                    // Разный сдвиг по расписанию, чтобы участники не шли в ногу
+                    size_t step = static_cast<size_t>(index) * 7919;
+                    for (int i = 0; i < opsPerProc; ++i) {
+                        int op = schedule[(step + i) % schedule.size()];
+                        int64_t start = monotonic_ns();
+                        switch (op) {
+                        case BENCH_ADD1:
+                            counter_update(sd, OP_ADD, 1, nullptr, false);
+                            break;
+                        case BENCH_ADD10:
+                            counter_update(sd, OP_ADD, 10, nullptr, false);
+                            break;
+                        case BENCH_MULDIV:
+                            counter_update(sd, OP_MUL, 2, nullptr, false);
+                            counter_update(sd, OP_DIV, 2, nullptr, false);
+                            result.ops++;
+                            break;
+                        case BENCH_SET:
+                            counter_update(sd, OP_SET, index, nullptr, false);
+                            break;
+                        }
+                        histogram_record(result.op, monotonic_ns() - start);
+                        result.ops++;
+                    }
+                    result.contextSwitches = context_switches() - switchesBefore;
+                    lockTiming = nullptr;
+                    release_counter_slot();
+                };
+                double seconds = threaded ? run_threaded_round(procs, worker) : run_forked_round(procs, worker);
+                if (seconds < 0) {
+                    munmap(results, resultsSize);
+                    cleanup_shared_memory(sd, isMaster);
+                    return 1;
+                }
+
+                BenchProcResult total;
+                std::memset(static_cast<void*>(&total), 0, sizeof(total));
+                for (int i = 0; i < procs; ++i) {
+                    histogram_merge(total.op, results[i].op);
+                    histogram_merge(total.lock.wait, results[i].lock.wait);
+                    histogram_merge(total.lock.hold, results[i].lock.hold);
+                    total.ops += results[i].ops;
+                    total.contextSwitches += results[i].contextSwitches;
+                }
+
+                auto percentiles = [](const LatencyHistogram& hist) {
+                    if (hist.total == 0) {
+                        return std::string("-");
+                    }
+                    return std::to_string(histogram_percentile(hist, 50)) + "/"
+                         + std::to_string(histogram_percentile(hist, 99)) + "/"
+                         + std::to_string(histogram_percentile(hist, 99.9));
+                };
+                char line[256];
+                snprintf(line, sizeof(line), "%-10s %-7s %5d %12.0f   %-22s %-22s %-22s %.4f",
+                         backend_name(backend), threaded ? "thread" : "process", procs, total.ops / seconds,
+                         percentiles(total.op).c_str(), percentiles(total.lock.wait).c_str(),
+                         percentiles(total.lock.hold).c_str(),
+                         static_cast<double>(total.contextSwitches) / std::max<uint64_t>(1, total.ops));
+                std::cout << line << std::endl;
+#ifdef __linux__
+                if (backend == BACKEND_FUTEX) {
+                    const ShmLockStats& stats = sd->lock.stats;
+                    uint64_t acquisitions = std::max<uint64_t>(1, stats.acquisitions.load());
+                    snprintf(line, sizeof(line), "                   lock: contended %.2f%%, spins/acq %.2f, futex waits/acq %.4f, owner deaths %llu",
+                             100.0 * stats.contended.load() / acquisitions,
+                             static_cast<double>(stats.spins.load()) / acquisitions,
+                             static_cast<double>(stats.futexWaits.load()) / acquisitions,
+                             static_cast<unsigned long long>(stats.ownerDeaths.load()));
+                    std::cout << line << std::endl;
+                }
+#endif
+            }
+
+            if (procs >= maxProcs) {
+                break;
+            }
+        }
+    }
+
+    munmap(results, resultsSize);
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция сравнения fork+exec копий и пула воркеров на одинаковых заданиях
+int run_pool_benchmark(const std::string& exePath, int workers, int jobs) {
+#ifndef __linux__
+    (void)exePath;
+    (void)workers;
+    (void)jobs;
+    std::cerr << "[ERROR] Пул воркеров поддерживается только на Linux." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+    start_log_drainer(sd, isMaster);
+
+    // Порождённые процессы печатают [INFO] в stdout - прячем его на время замеров
+    std::cout.flush();
+    int savedStdout = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+
+    struct Result {
+        const char* path;
+        int mode;
+        double seconds;
+        uint64_t completed;
+        double dispatchAvgUs;
+        double dispatchMaxUs;
+        double totalAvgUs;
+    };
+    std::vector<Result> results;
+
+    auto reset_stats = [&](int mode) {
+        JobStats& stats = sd->jobQueue.stats[mode];
+        stats.completed.store(0);
+        stats.dispatchSumNs.store(0);
+        stats.dispatchMaxNs.store(0);
+        stats.totalSumNs.store(0);
+    };
+    auto collect_stats = [&](const char* path, int mode, double seconds) {
+        JobStats& stats = sd->jobQueue.stats[mode];
+        uint64_t completed = stats.completed.load();
+        double done = static_cast<double>(std::max<uint64_t>(1, completed));
+        results.push_back({ path, mode, seconds, completed,
+                            stats.dispatchSumNs.load() / 1e3 / done,
+                            stats.dispatchMaxNs.load() / 1e3,
+                            stats.totalSumNs.load() / 1e3 / done });
+    };
+
+    // Копии через fork+exec: не больше workers одновременно, как и у пула
+    for (int mode = 1; mode <= 2; ++mode) {
+        reset_stats(mode);
+        int64_t start = monotonic_ns();
+        int alive = 0;
+        for (int launched = 0; launched < jobs; ) {
+            if (alive < workers) {
+                pid_t child = fork_exec({ exePath, "--child", std::to_string(mode), "--hold", "0",
+                                          "--submit-ns", std::to_string(monotonic_ns()) });
+                if (child < 0) {
+                    break;
+                }
+                ++alive;
+                ++launched;
+            } else {
+                int status;
+                if (waitpid(-1, &status, 0) > 0) {
+                    --alive;
+                }
+            }
+        }
+        int status;
+        while (alive > 0 && waitpid(-1, &status, 0) > 0) {
+            --alive;
+        }
+        collect_stats("fork+exec", mode, (monotonic_ns() - start) / 1e9);
+    }
+
+    // Пул воркеров: задания через очередь в разделяемой памяти
+    bool poolStarted = start_worker_pool(sd, exePath, workers);
+    sleep_ms(200); // Даём воркерам инициализироваться, чтобы не мерить их запуск
+    for (int mode = 1; poolStarted && mode <= 2; ++mode) {
+        reset_stats(mode);
+        int64_t start = monotonic_ns();
+        for (int submitted = 0; submitted < jobs; ) {
+            if (job_queue_push(sd->jobQueue, mode, 0)) {
+                ++submitted;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        while (sd->jobQueue.stats[mode].completed.load(std::memory_order_acquire) < static_cast<uint64_t>(jobs)) {
+            std::this_thread::yield();
+        }
+        collect_stats("pool", mode, (monotonic_ns() - start) / 1e9);
+    }
+    stop_worker_pool(sd);
+
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+
+    std::cout << "path        mode   jobs   time, s     jobs/s   dispatch avg/max, us   total avg, us" << std::endl;
+    for (const Result& r : results) {
+        char line[160];
+        snprintf(line, sizeof(line), "%-10s %5d %6llu %9.3f %10.0f %12.1f / %-9.1f %12.1f",
+                 r.path, r.mode, static_cast<unsigned long long>(r.completed), r.seconds,
+                 r.completed / r.seconds, r.dispatchAvgUs, r.dispatchMaxUs, r.totalAvgUs);
+        std::cout << line << std::endl;
+    }
+
+    stop_log_drainer();
+    cleanup_shared_memory(sd, isMaster);
+    return poolStarted ? 0 : 1;
+#endif
+}
+
+// Функция сравнения текстового и бинарного лога: байты и процессорное время на сообщение
+int run_log_benchmark(int messages) {
+#ifdef _WIN32
+    (void)messages;
+    std::cerr << "[ERROR] Бинарный лог поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+    // Здесь объём лога и есть результат, поэтому пишем во временные файлы, а не в /dev/null
+    LOG_FILE = "/tmp/hw3_bench_log.txt";
+    LOG_BIN_FILE = "/tmp/hw3_bench_log.bin";
+    logRotation.maxBytes = 0;
+    logRotation.intervalSec = 0;
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    std::cout << "format   messages        bytes   bytes/msg   cpu ns/msg   overflows" << std::endl;
+    for (int binary = 0; binary <= 1; ++binary) {
+        const char* path = binary ? LOG_BIN_FILE : LOG_FILE;
+        unlink(path);
+        sd->binaryLog = binary != 0;
+        sd->logRing.overflows.store(0);
+        start_log_drainer(sd, isMaster);
+
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        for (int i = 0; i < messages; ++i) {
+            // Не даём кольцам переполниться: меряем основной путь, а не запасной
+            auto& lines = sd->logRing.lines;
+            auto& events = sd->logRing.events;
+            while (lines.head.load() - lines.tail.load() > LOG_RING_CAPACITY / 2
+                   || events.head.load() - events.tail.load() > EVENT_RING_CAPACITY / 2) {
+                sleep_ms(1);
+            }
+            log_event<LEVEL_INFO>(sd, EV_MASTER_REPORT, i, 0, isMaster);
+        }
+        stop_log_drainer(); // Учитываем и работу потока, дописывающего файл
+        getrusage(RUSAGE_SELF, &after);
+
+        auto cpu_ns = [](const struct rusage& r) {
+            return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * 1000000000LL
+                 + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) * 1000LL;
+        };
+        struct stat st;
+        long long bytes = stat(path, &st) == 0 ? static_cast<long long>(st.st_size) : 0;
+        char line[160];
+        snprintf(line, sizeof(line), "%-6s %10d %12lld %11.1f %12.0f %11llu",
+                 binary ? "binary" : "text", messages, bytes, static_cast<double>(bytes) / messages,
+                 static_cast<double>(cpu_ns(after) - cpu_ns(before)) / messages,
+                 static_cast<unsigned long long>(sd->logRing.overflows.load()));
+        std::cout << line << std::endl;
+        unlink(path);
+    }
+
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция замера реестра счётчиков: поиск по имени и изменение через дескриптор
+int run_registry_benchmark(int maxProcs, int opsPerProc) {
+#ifdef _WIN32
+    (void)maxProcs;
+    (void)opsPerProc;
+    std::cerr << "[ERROR] Режим сравнения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    // Заполняем реестр наполовину: цепочки пробирования как при реальной нагрузке
+    const int NAMES = REGISTRY_CAPACITY / 2;
+    std::vector<std::string> names;
+    std::vector<NamedCounter*> handles;
+    for (int i = 0; i < NAMES; ++i) {
+        names.push_back("bench." + std::to_string(i));
+        handles.push_back(open_counter(sd, names.back().c_str()));
+    }
+
+    std::cout << "counters=" << NAMES << ", ops/proc=" << opsPerProc << std::endl;
+    std::cout << "procs    lookups/s    updates/s   check" << std::endl;
+    for (int procs = 1; ; procs = std::min(procs * 2, maxProcs)) {
+        for (NamedCounter* handle : handles) {
+            handle->value.store(0);
+        }
+        // Псевдослучайный выбор имени, свой у каждого процесса
+        auto pick = [](uint64_t& state) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<int>((state >> 33) % NAMES);
+        };
+        double lookupSeconds = run_forked_round(procs, [&](int index) {
+            uint64_t state = index + 1;
+            for (int i = 0; i < opsPerProc; ++i) {
+                if (open_counter(sd, names[pick(state)].c_str(), false) == nullptr) {
+                    _exit(1);
+                }
+            }
+        });
+        double updateSeconds = run_forked_round(procs, [&](int index) {
+            uint64_t state = index + 1;
+            for (int i = 0; i < opsPerProc; ++i) {
+                handles[pick(state)]->value.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        if (lookupSeconds < 0 || updateSeconds < 0) {
+            cleanup_shared_memory(sd, isMaster);
+            return 1;
+        }
+
+        int64_t total = 0;
+        for (NamedCounter* handle : handles) {
+            total += handle->value.load();
+        }
+        double ops = static_cast<double>(procs) * opsPerProc;
+        char line[160];
+        snprintf(line, sizeof(line), "%5d %12.0f %12.0f   %s",
+                 procs, ops / lookupSeconds, ops / updateSeconds,
+                 total == static_cast<int64_t>(ops) ? "ok" : "LOST UPDATES");
+        std::cout << line << std::endl;
+
+        if (procs >= maxProcs) {
+            break;
+        }
+    }
+
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция замера выделения памяти в арене: процессы одновременно выделяют и освобождают блоки
+int run_arena_benchmark(int maxProcs, int opsPerProc) {
+#ifndef __linux__
+    (void)maxProcs;
+    (void)opsPerProc;
+    std::cerr << "[ERROR] Арена поддерживается только на Linux." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster || arena.base == nullptr) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        if (sd != nullptr) {
+            cleanup_shared_memory(sd, isMaster);
+        }
+        return 1;
+    }
+
+    std::atomic<int>* corrupted = static_cast<std::atomic<int>*>(mmap(NULL, sizeof(std::atomic<int>),
+                                                                     PROT_READ | PROT_WRITE,
+                                                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (corrupted == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+    corrupted->store(0);
+
+    const int LIVE = 64; // Сколько блоков процесс держит одновременно
+    ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena.base);
+    std::cout << "ops/proc=" << opsPerProc << " (alloc or free), live blocks/proc=" << LIVE
+              << ", sizes 16..2048" << std::endl;
+    std::cout << "procs        ops/s   arena, KB   grows   check" << std::endl;
+    for (int procs = 1; ; procs = std::min(procs * 2, maxProcs)) {
+        uint64_t growsBefore = header->grows.load();
+        double seconds = run_forked_round(procs, [&](int index) {
+            uint64_t live[LIVE] = {};
+            uint64_t state = index + 1;
+            for (int i = 0; i < opsPerProc; ++i) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                int slot = static_cast<int>((state >> 33) % LIVE);
+                uint64_t tag = (static_cast<uint64_t>(index) << 32) | static_cast<uint32_t>(slot);
+                if (live[slot] == 0) {
+                    size_t size = 16u << ((state >> 20) % 8);
+                    live[slot] = arena_alloc(size);
+                    if (live[slot] != 0) {
+                        *static_cast<uint64_t*>(arena_resolve(live[slot], sizeof(uint64_t))) = tag;
+                    }
+                } else {
+                    // Чужой процесс не должен был получить наш блок
+                    if (*static_cast<uint64_t*>(arena_resolve(live[slot], sizeof(uint64_t))) != tag) {
+                        corrupted->fetch_add(1);
+                    }
+                    arena_free(live[slot]);
+                    live[slot] = 0;
+                }
+            }
+            for (uint64_t offset : live) {
+                arena_free(offset);
+            }
+        });
+        if (seconds < 0) {
+            break;
+        }
+
+        char line[160];
+        snprintf(line, sizeof(line), "%5d %12.0f %11llu %7llu   %s",
+                 procs, static_cast<double>(procs) * opsPerProc / seconds,
+                 static_cast<unsigned long long>(header->size.load() / 1024),
+                 static_cast<unsigned long long>(header->grows.load() - growsBefore),
+                 corrupted->load() == 0 ? "ok" : "CORRUPTED");
+        std::cout << line << std::endl;
+
+        if (procs >= maxProcs) {
+            break;
+        }
+    }
+
+    munmap(corrupted, sizeof(std::atomic<int>));
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция замера файла сохранения: цена записи WAL на операцию, контрольной точки и восстановления
+int run_persist_benchmark(int ops) {
+#ifdef _WIN32
+    (void)ops;
+    std::cerr << "[ERROR] Файл сохранения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+    const char* path = "/tmp/hw3_bench_persist.bin";
+    unlink(path);
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    MasterSettings settings;
+    settings.persistPath = path;
+    if (!initialize_shared_memory(&sd, isMaster, settings) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+    PersistFile* file = persistFile;
+
+    std::cout << "ops=" << ops << std::endl;
+    std::cout << "backend  mode        ops/s    ns/op" << std::endl;
+    for (int backend : { BACKEND_MUTEX, BACKEND_ATOMIC }) {
+        sd->backend = backend;
+        for (int persist = 0; persist <= 1; ++persist) {
+            persistFile = persist ? file : nullptr;
+            int64_t start = monotonic_ns();
+            for (int i = 0; i < ops; ++i) {
+                counter_update(sd, OP_ADD, 1, nullptr, isMaster);
+            }
+            double ns = static_cast<double>(monotonic_ns() - start) / ops;
+            char line[128];
+            snprintf(line, sizeof(line), "%-8s %-6s %12.0f %8.1f",
+                     backend_name(backend), persist ? "wal" : "shm", 1e9 / ns, ns);
+            std::cout << line << std::endl;
+        }
+    }
+    persistFile = file;
+
+    // Контрольная точка: msync всего файла
+    const int ROUNDS = 20;
+    int64_t start = monotonic_ns();
+    for (int i = 0; i < ROUNDS; ++i) {
+        counter_update(sd, OP_ADD, 1, nullptr, isMaster);
+        persist_checkpoint(main_counter(sd).load(), persistFile->walSeq.load());
+    }
+    double checkpointUs = (monotonic_ns() - start) / 1e3 / ROUNDS;
+
+    // Восстановление после "падения": несколько записей WAL новее контрольной точки
+    for (int i = 0; i < 100; ++i) {
+        counter_update(sd, OP_ADD, 1, nullptr, isMaster);
+    }
+    int64_t expected = main_counter(sd).load();
+    close_persist_file();
+    start = monotonic_ns();
+    int64_t value = 0;
+    bool recovered = false;
+    bool ok = open_persist_file(path, true, value, recovered);
+    double recoverUs = (monotonic_ns() - start) / 1e3;
+    std::cout << "checkpoint (msync): " << checkpointUs << " us, recovery (open+mmap+scan): "
+              << recoverUs << " us, value " << (ok && recovered && value == expected ? "ok" : "MISMATCH")
+              << std::endl;
+
+    cleanup_shared_memory(sd, isMaster);
+    unlink(path);
+    return 0;
+#endif
+}
+
+// Функция замера транзакций: пропускная способность и доля повторов при разной длине вычисления
+int run_txn_benchmark(int maxProcs, int opsPerProc) {
+#ifdef _WIN32
+    (void)maxProcs;
+    (void)opsPerProc;
+    std::cerr << "[ERROR] Режим сравнения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    MasterSettings settings;
+    settings.backend = BACKEND_OPTIMISTIC;
+    if (!initialize_shared_memory(&sd, isMaster, settings) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    size_t conflictsSize = sizeof(uint64_t) * maxProcs;
+    uint64_t* conflicts = static_cast<uint64_t*>(mmap(NULL, conflictsSize, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (conflicts == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+
+    std::cout << "transactions: +1 after busy work of the given length" << std::endl;
+    std::cout << "procs  work, ns      commits/s   retries/commit   check" << std::endl;
+    for (int procs = 1; ; procs = std::min(procs * 2, maxProcs)) {
+        for (int64_t workNs : { 0, 1000, 10000 }) {
+            // Долгие транзакции - меньше операций, чтобы замер не растягивался
+            int ops = workNs == 0 ? opsPerProc : std::max(1, static_cast<int>(opsPerProc * 50 / workNs));
+            main_counter(sd).store(0);
+            std::memset(conflicts, 0, conflictsSize);
+            double seconds = run_forked_round(procs, [&](int index) {
+                uint64_t local = 0;
+                for (int i = 0; i < ops; ++i) {
+                    counter_transaction(sd, [&](int64_t current) {
+                        int64_t until = monotonic_ns() + workNs;
+                        while (workNs > 0 && monotonic_ns() < until) {
+                        }
+                        return current + 1;
+                    }, &local);
+                }
+                conflicts[index] = local;
+            });
+            if (seconds < 0) {
+                break;
+            }
+            uint64_t retries = 0;
+            for (int i = 0; i < procs; ++i) {
+                retries += conflicts[i];
+            }
+            int64_t commits = static_cast<int64_t>(procs) * ops;
+            char line[160];
+            snprintf(line, sizeof(line), "%5d %9lld %14.0f %16.4f   %s",
+                     procs, static_cast<long long>(workNs), commits / seconds,
+                     static_cast<double>(retries) / commits,
+                     main_counter(sd).load() == commits ? "ok" : "LOST UPDATES");
+            std::cout << line << std::endl;
+        }
+        if (procs >= maxProcs) {
+            break;
+        }
+    }
+
+    munmap(conflicts, conflictsSize);
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция замера задержки уведомлений: подписчик в отдельном процессе ждёт в wait_for_change,
+// писатель делает редкие изменения; печатаются перцентили задержки от публикации до пробуждения
+int run_notify_benchmark(int updates) {
+#ifdef _WIN32
+    (void)updates;
+    std::cerr << "[ERROR] Режим сравнения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    size_t latencySize = sizeof(int64_t) * updates;
+    int64_t* latency = static_cast<int64_t*>(mmap(NULL, latencySize, PROT_READ | PROT_WRITE,
+                                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (latency == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+    std::memset(latency, 0, latencySize);
+
+    pid_t waiter = fork();
+    if (waiter < 0) {
+        perror("[ERROR] fork");
+        munmap(latency, latencySize);
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+    if (waiter == 0) {
+        uint32_t seq = sd->snapshot.seq.load(std::memory_order_acquire);
+        for (int i = 0; i < updates; ++i) {
+            if (!wait_for_change(sd, seq, 1000, seq)) {
+                break;
+            }
+            CounterSnapshot snap;
+            read_counter_snapshot(sd, snap);
+            latency[i] = realtime_ns() - snap.updateNs;
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    for (int i = 0; i < updates; ++i) {
+        // Каждое изменение - только когда подписчик снова спит, иначе это замер опроса
+        while (sd->changeWaiters.load() == 0) {
+            std::this_thread::yield();
+        }
+        sleep_ms(1);
+        counter_update(sd, OP_ADD, 1, nullptr, true);
+    }
+    int status;
+    waitpid(waiter, &status, 0);
+
+    std::vector<int64_t> samples;
+    for (int i = 0; i < updates; ++i) {
+        if (latency[i] > 0) {
+            samples.push_back(latency[i]);
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    if (samples.empty()) {
+        std::cerr << "[ERROR] Подписчик не получил ни одного уведомления." << std::endl;
+    } else {
+        auto percentile = [&](double p) {
+            return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))] / 1000.0;
+        };
+        char line[200];
+        snprintf(line, sizeof(line), "notify: %zu/%d observed, latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f",
+                 samples.size(), updates, percentile(0.5), percentile(0.9), percentile(0.99),
+                 samples.back() / 1000.0);
+        std::cout << line << std::endl;
+    }
+
+    munmap(latency, latencySize);
+    cleanup_shared_memory(sd, isMaster);
+    return samples.empty() ? 1 : 0;
+#endif
+}
+
+#ifdef __linux__
+// Транспорты в сравнении доставки заданий от мастера воркерам
+enum IpcTransport : int {
+    IPC_SHM_SPIN = 0,    // Кольцо очереди заданий, воркеры опрашивают его
+    IPC_SHM_FUTEX = 1,   // То же кольцо, спящих воркеров будит futex (как у пула)
+    IPC_SHM_EVENTFD = 2, // То же кольцо, о каждом задании сообщает eventfd в режиме семафора
+    IPC_PIPE = 3,
+    IPC_MQUEUE = 4,      // Очередь сообщений POSIX
+    IPC_DGRAM = 5,       // Дейтаграммный Unix-сокет
+    IPC_TRANSPORT_COUNT = 6
+};
+
+const char* const IPC_TRANSPORT_NAMES[IPC_TRANSPORT_COUNT] = {
+    "shm-spin", "shm-futex", "shm-eventfd", "pipe", "mqueue", "unix-dgram"
+};
+
+// Канал доставки: создаётся до fork, поэтому воркеры наследуют его дескрипторы
+struct IpcChannel {
+    IpcTransport transport;
+    JobQueue* queue;
+    int fds[2] = { -1, -1 }; // pipe и сокет: [0] - чтение, [1] - запись; eventfd - [0]
+    mqd_t mq = static_cast<mqd_t>(-1);
+};
+
+// Функция открытия канала
+bool ipc_open(IpcChannel& ch, SharedData* sd, IpcTransport transport) {
+    ch.transport = transport;
+    ch.queue = &sd->jobQueue;
+    ring_init(ch.queue->jobs);
+    ch.queue->sleepers.store(0);
+    switch (transport) {
+    case IPC_SHM_SPIN:
+    case IPC_SHM_FUTEX:
+        return true;
+    case IPC_SHM_EVENTFD:
+        ch.fds[0] = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+        return ch.fds[0] >= 0;
+    case IPC_PIPE:
+        return pipe2(ch.fds, O_CLOEXEC) == 0;
+    case IPC_MQUEUE: {
+        struct mq_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.mq_maxmsg = 10; // Предел по умолчанию для непривилегированных процессов
+        attr.mq_msgsize = sizeof(Job);
+        const char* name = "/hw3_bench_ipc";
+        mq_unlink(name);
+        ch.mq = mq_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600, &attr);
+        mq_unlink(name); // Дескрипторы уже есть, имя больше не нужно
+        return ch.mq != static_cast<mqd_t>(-1);
+    }
+    case IPC_DGRAM: {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, pair) == -1) {
+            return false;
+        }
+        ch.fds[0] = pair[1];
+        ch.fds[1] = pair[0];
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Функция закрытия канала
+void ipc_close(IpcChannel& ch) {
+    for (int& fd : ch.fds) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (ch.mq != static_cast<mqd_t>(-1)) {
+        mq_close(ch.mq);
+        ch.mq = static_cast<mqd_t>(-1);
+    }
+}
+
+// Функция отправки задания; при заполненном канале ждёт места
+bool ipc_send(IpcChannel& ch, const Job& job) {
+    switch (ch.transport) {
+    case IPC_SHM_SPIN:
+        while (!ring_push(ch.queue->jobs, job)) {
+            std::this_thread::yield();
+        }
+        return true;
+    case IPC_SHM_FUTEX:
+        while (!job_queue_push(*ch.queue, job.mode, job.holdMs)) {
+            std::this_thread::yield();
+        }
+        return true;
+    case IPC_SHM_EVENTFD: {
+        while (!ring_push(ch.queue->jobs, job)) {
+            std::this_thread::yield();
+        }
+        uint64_t one = 1;
+        return write(ch.fds[0], &one, sizeof(one)) == sizeof(one);
+    }
+    case IPC_PIPE:
+        // Запись не больше PIPE_BUF атомарна: задания разных писателей не перемешиваются
+        return write(ch.fds[1], &job, sizeof(job)) == sizeof(job);
+    case IPC_MQUEUE:
+        return mq_send(ch.mq, reinterpret_cast<const char*>(&job), sizeof(job), 0) == 0;
+    case IPC_DGRAM:
+        return send(ch.fds[1], &job, sizeof(job), 0) == sizeof(job);
+    default:
+        return false;
+    }
+}
+
+// Функция получения задания; ждёт, пока оно появится
+bool ipc_recv(IpcChannel& ch, Job& job) {
+    switch (ch.transport) {
+    case IPC_SHM_SPIN:
+        while (!ring_pop(ch.queue->jobs, job)) {
+            std::this_thread::yield();
+        }
+        return true;
+    case IPC_SHM_FUTEX:
+        while (true) {
+            uint32_t seen = ch.queue->futexWord.load();
+            if (ring_pop(ch.queue->jobs, job)) {
+                return true;
+            }
+            ch.queue->sleepers.fetch_add(1);
+            futex_wait(&ch.queue->futexWord, seen, NULL);
+            ch.queue->sleepers.fetch_sub(1);
+        }
+    case IPC_SHM_EVENTFD: {
+        uint64_t token;
+        if (read(ch.fds[0], &token, sizeof(token)) != sizeof(token)) {
+            return false;
+        }
+        // Задание опубликовано до сигнала, так что оно уже в кольце
+        while (!ring_pop(ch.queue->jobs, job)) {
+            std::this_thread::yield();
+        }
+        return true;
+    }
+    case IPC_PIPE:
+        return read(ch.fds[0], &job, sizeof(job)) == sizeof(job);
+    case IPC_MQUEUE:
+        return mq_receive(ch.mq, reinterpret_cast<char*>(&job), sizeof(job), NULL) == sizeof(job);
+    case IPC_DGRAM:
+        return recv(ch.fds[0], &job, sizeof(job), 0) == sizeof(job);
+    default:
+        return false;
+    }
+}
+#endif
+
+// Функция замера режима sloppy: сколько изменений SharedData (и захватов мьютекса)
+// остаётся от прибавлений при разном пороге сброса
+int run_sloppy_benchmark(int maxProcs, int opsPerProc) {
+#ifdef _WIN32
+    (void)maxProcs;
+    (void)opsPerProc;
+    std::cerr << "[ERROR] Режим сравнения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    // На процесс: число сбросов и переключений контекста
+    size_t perProcSize = sizeof(uint64_t) * 2 * maxProcs;
+    uint64_t* perProc = static_cast<uint64_t*>(mmap(NULL, perProcSize, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (perProc == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+
+    std::cout << "backend " << backend_name(sd->backend) << ", +1 per operation" << std::endl;
+    std::cout << "procs  threshold         adds/s   shared updates   per 1000 adds   cs/1000 adds   check" << std::endl;
+    for (int procs = 1; ; procs = std::min(procs * 2, maxProcs)) {
+        for (int threshold : { 1, 4, 16, 64, 256, 1024 }) {
+            sd->sloppyOps = threshold;
+            sd->sloppyMs = 0;
+            main_counter(sd).store(0);
+            std::memset(perProc, 0, perProcSize);
+            double seconds = run_forked_round(procs, [&](int index) {
+                uint64_t cs = context_switches();
+                for (int i = 0; i < opsPerProc; ++i) {
+                    counter_update(sd, OP_ADD, 1, nullptr, false);
+                }
+                flush_sloppy_delta(sd, false);
+                perProc[index * 2] = sloppy_enabled(sd) ? sloppy.flushes : opsPerProc;
+                perProc[index * 2 + 1] = context_switches() - cs;
+            });
+            if (seconds < 0) {
+                break;
+            }
+            uint64_t updates = 0, cs = 0;
+            for (int i = 0; i < procs; ++i) {
+                updates += perProc[i * 2];
+                cs += perProc[i * 2 + 1];
+            }
+            int64_t adds = static_cast<int64_t>(procs) * opsPerProc;
+            char line[200];
+            snprintf(line, sizeof(line), "%5d %10d %14.0f %16llu %15.2f %14.2f   %s",
+                     procs, threshold, adds / seconds, static_cast<unsigned long long>(updates),
+                     1000.0 * updates / adds, 1000.0 * cs / adds,
+                     main_counter(sd).load() == adds ? "ok" : "LOST UPDATES");
+            std::cout << line << std::endl;
+        }
+        if (procs >= maxProcs) {
+            break;
+        }
+    }
+
+    sd->sloppyOps = 0;
+    munmap(perProc, perProcSize);
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция сравнения форматирования меток времени на пути записи в лог: прежняя
+// get_current_time_string, строка события без кэша и с кэшем префикса, и сами метки
+int run_timefmt_benchmark(int maxProcs, int opsPerProc) {
+#ifdef _WIN32
+    (void)maxProcs;
+    (void)opsPerProc;
+    std::cerr << "[ERROR] Режим сравнения поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    size_t resultsSize = sizeof(LatencyHistogram) * maxProcs;
+    LatencyHistogram* results = static_cast<LatencyHistogram*>(mmap(NULL, resultsSize, PROT_READ | PROT_WRITE,
+                                                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (results == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+
+    const char* const names[] = { "time string", "event", "event cached", "stamp", "stamp cached" };
+    std::cout << "ops/proc=" << opsPerProc << ", each op reads CLOCK_REALTIME, latencies in ns" << std::endl;
+    std::cout << "format        procs        ops/s   p50/p99/p999" << std::endl;
+    for (int variant = 0; variant < 5; ++variant) {
+        for (int procs = 1; ; procs = std::min(procs * 2, maxProcs)) {
+            std::memset(static_cast<void*>(results), 0, resultsSize);
+            double seconds = run_forked_round(procs, [&](int index) {
+                LatencyHistogram& hist = results[index];
+                EventRecord ev;
+                std::memset(&ev, 0, sizeof(ev));
+                ev.pid = cached_process_id();
+                ev.kind = EV_COPY1_START;
+                char buf[TIME_TEXT_SIZE];
+                size_t check = 0;
+                for (int i = 0; i < opsPerProc; ++i) {
+                    int64_t start = monotonic_ns();
+                    switch (variant) {
+                    case 0:
+                        check += get_current_time_string().size();
+                        break;
+                    case 1:
+                        ev.timeNs = realtime_ns();
+                        check += format_event(ev).size();
+                        break;
+                    case 2:
+                        ev.timeNs = realtime_ns();
+                        check += format_event(ev, cached_format_time).size();
+                        break;
+                    case 3:
+                        check += format_time_ns(realtime_ns(), buf)[TIME_PREFIX_LEN + 3];
+                        break;
+                    case 4:
+                        check += cached_format_time(realtime_ns(), buf)[TIME_PREFIX_LEN + 3];
+                        break;
+                    }
+                    histogram_record(hist, monotonic_ns() - start);
+                }
+                // Результат нужен, иначе компилятор вправе выбросить форматирование
+                if (check == 0) {
+                    std::cerr << "[ERROR] Пустые метки времени." << std::endl;
+                }
+            });
+            if (seconds < 0) {
+                break;
+            }
+            LatencyHistogram total;
+            std::memset(&total, 0, sizeof(total));
+            for (int i = 0; i < procs; ++i) {
+                histogram_merge(total, results[i]);
+            }
+            char line[160];
+            snprintf(line, sizeof(line), "%-12s %6d %12.0f   %llu/%llu/%llu", names[variant], procs,
+                     static_cast<double>(procs) * opsPerProc / seconds,
+                     static_cast<unsigned long long>(histogram_percentile(total, 50)),
+                     static_cast<unsigned long long>(histogram_percentile(total, 99)),
+                     static_cast<unsigned long long>(histogram_percentile(total, 99.9)));
+            std::cout << line << std::endl;
+            if (procs >= maxProcs) {
+                break;
+            }
+        }
+    }
+
+    munmap(results, resultsSize);
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция замера времени перехвата роли мастера: процесс-владелец аренды останавливается
+// (SIGKILL - завершился, SIGSTOP - завис), slaves процессов ждут аренду, как слейвы в
+// run_event_loop. Время считается от сигнала до перехвата
+int run_failover_benchmark(int slaves, int rounds, int leaseMs) {
+#ifndef __linux__
+    (void)slaves;
+    (void)rounds;
+    (void)leaseMs;
+    std::cerr << "[ERROR] Перехват роли мастера поддерживается только на Linux." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+    if (leaseMs <= 0) {
+        std::cerr << "[ERROR] Нужен срок аренды: --lease-ms N, N > 0." << std::endl;
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+    MasterLease& lease = sd->lease;
+    lease.leaseMs.store(leaseMs);
+
+    // На раунд: время первого перехвата и число перехватов (должен быть ровно один)
+    struct FailoverRound {
+        std::atomic<int64_t> takeoverNs;
+        std::atomic<int> winners;
+        std::atomic<bool> done;
+    };
+    size_t resultsSize = sizeof(FailoverRound) * rounds;
+    FailoverRound* results = static_cast<FailoverRound*>(mmap(NULL, resultsSize, PROT_READ | PROT_WRITE,
+                                                              MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (results == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+
+    std::cout << "lease=" << leaseMs << " ms, renew/check every " << leaseMs / 4.0 << " ms, slaves=" << slaves
+              << ", rounds=" << rounds << ", failover in ms" << std::endl;
+    std::cout << "owner     rounds      p50      p99      max   one winner" << std::endl;
+    for (int sig : { SIGKILL, SIGSTOP }) {
+        std::memset(static_cast<void*>(results), 0, resultsSize);
+        LatencyHistogram hist;
+        std::memset(&hist, 0, sizeof(hist));
+        bool oneWinner = true;
+        for (int round = 0; round < rounds; ++round) {
+            pid_t owner = fork();
+            if (owner == 0) {
+                // Владелец продлевает аренду, пока его не остановят
+                int32_t self = cached_process_id();
+                lease_assign(lease, self);
+                while (lease_renew(lease, self)) {
+                    lease_wait(lease, lease.epoch.load(std::memory_order_acquire));
+                }
+                _exit(EXIT_SUCCESS);
+            }
+            if (owner < 0) {
+                perror("[ERROR] fork");
+                break;
+            }
+            while (lease_owner(lease.owner.load()) != owner) {
+                std::this_thread::yield();
+            }
+
+            std::vector<pid_t> children;
+            for (int i = 0; i < slaves; ++i) {
+                pid_t child = fork();
+                if (child == 0) {
+                    // Победитель остаётся мастером и продлевает аренду до конца раунда, остальные
+                    // продолжают проверять её: повторный перехват у живого победителя - ошибка
+                    int32_t self = cached_process_id();
+                    bool won = false;
+                    while (!results[round].done.load()) {
+                        uint32_t epoch = lease.epoch.load(std::memory_order_acquire);
+                        int32_t previousOwner;
+                        if (won) {
+                            lease_renew(lease, self);
+                        } else if (lease_try_take_over(lease, self, previousOwner)) {
+                            won = true;
+                            int64_t none = 0;
+                            results[round].takeoverNs.compare_exchange_strong(none, monotonic_ns());
+                            results[round].winners.fetch_add(1);
+                        }
+                        lease_wait(lease, epoch);
+                    }
+                    _exit(EXIT_SUCCESS);
+                }
+                if (child > 0) {
+                    children.push_back(child);
+                }
+            }
+
+            // Сигнал в разные моменты между продлениями аренды
+            sleep_ms(leaseMs + leaseMs * (round % 4) / 8);
+            int64_t signalNs = monotonic_ns();
+            kill(owner, sig);
+            if (sig == SIGKILL) {
+                waitpid(owner, NULL, 0); // Пока зомби не собран, kill(pid, 0) считает его живым
+            }
+            // После перехвата раунд длится ещё два срока аренды, чтобы проявился второй перехват
+            int64_t deadlineNs = signalNs + leaseMs * 10 * 1000000LL;
+            while (results[round].winners.load() == 0 && monotonic_ns() < deadlineNs) {
+                sleep_ms(1);
+            }
+            sleep_ms(leaseMs * 2);
+            results[round].done.store(true);
+            for (pid_t child : children) {
+                waitpid(child, NULL, 0);
+            }
+            if (sig == SIGSTOP) {
+                kill(owner, SIGKILL);
+                waitpid(owner, NULL, 0);
+            }
+            if (results[round].winners.load() > 0) {
+                histogram_record(hist, results[round].takeoverNs.load() - signalNs);
+            }
+            oneWinner = oneWinner && results[round].winners.load() == 1;
+        }
+        char line[160];
+        snprintf(line, sizeof(line), "%-9s %6d %8.2f %8.2f %8.2f   %s", sig == SIGKILL ? "killed" : "stopped",
+                 static_cast<int>(hist.total), histogram_percentile(hist, 50) / 1e6,
+                 histogram_percentile(hist, 99) / 1e6, histogram_percentile(hist, 100) / 1e6,
+                 oneWinner ? "yes" : "NO");
+        std::cout << line << std::endl;
+    }
+
+    lease_assign(lease, cached_process_id());
+    munmap(results, resultsSize);
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция сравнения транспортов доставки заданий: мастер отправляет задания workers
+// воркерам. Пакетный прогон показывает пропускную способность и задержку под нагрузкой,
+// прогон по одному заданию - задержку доставки в простое
+int run_ipc_benchmark(int workers, int messages) {
+#ifndef __linux__
+    (void)workers;
+    (void)messages;
+    std::cerr << "[ERROR] Сравнение транспортов поддерживается только на Linux." << std::endl;
+    return 1;
+#else
+    use_bench_segment();
+
+    SharedData* sd = nullptr;
+    bool isMaster = false;
+    if (!initialize_shared_memory(&sd, isMaster) || !isMaster) {
+        std::cerr << "[ERROR] Не удалось создать сегмент для сравнения." << std::endl;
+        return 1;
+    }
+
+    // Счётчик полученных заданий и гистограмма на каждого воркера
+    size_t resultsSize = 64 + sizeof(LatencyHistogram) * workers;
+    char* results = static_cast<char*>(mmap(NULL, resultsSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (results == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        cleanup_shared_memory(sd, isMaster);
+        return 1;
+    }
+    std::atomic<uint64_t>* received = reinterpret_cast<std::atomic<uint64_t>*>(results);
+    LatencyHistogram* hists = reinterpret_cast<LatencyHistogram*>(results + 64);
+
+    // Прогон: процесс 0 - мастер, остальные - воркеры; mode == 0 - сигнал остановки
+    auto round = [&](IpcChannel& ch, int count, bool paced, LatencyHistogram& total) {
+        std::memset(results, 0, resultsSize);
+        double seconds = run_forked_round(workers + 1, [&](int index) {
+            if (index == 0) {
+                for (int i = 0; i < count; ++i) {
+                    Job job = { 1, 0, monotonic_ns() };
+                    ipc_send(ch, job);
+                    while (paced && received->load(std::memory_order_acquire) < static_cast<uint64_t>(i + 1)) {
+                        std::this_thread::yield();
+                    }
+                }
+                for (int w = 0; w < workers; ++w) {
+                    Job stop = { 0, 0, 0 };
+                    ipc_send(ch, stop);
+                }
+                return;
+            }
+            Job job;
+            while (ipc_recv(ch, job) && job.mode != 0) {
+                histogram_record(hists[index - 1], monotonic_ns() - job.submitNs);
+                received->fetch_add(1, std::memory_order_release);
+            }
+        });
+        std::memset(&total, 0, sizeof(total));
+        for (int w = 0; w < workers; ++w) {
+            histogram_merge(total, hists[w]);
+        }
+        return seconds;
+    };
+
+    int pacedCount = std::min(messages, 5000);
+    std::cout << "transport     workers        msgs/s   burst p50/p99, us   single p50/p99, us   delivered" << std::endl;
+    for (int t = 0; t < IPC_TRANSPORT_COUNT; ++t) {
+        IpcChannel ch;
+        if (!ipc_open(ch, sd, static_cast<IpcTransport>(t))) {
+            std::cerr << "[ERROR] Транспорт " << IPC_TRANSPORT_NAMES[t] << " недоступен: " << strerror(errno) << std::endl;
+            ipc_close(ch);
+            continue;
+        }
+        LatencyHistogram burst, single;
+        double seconds = round(ch, messages, false, burst);
+        round(ch, pacedCount, true, single);
+        ipc_close(ch);
+
+        char line[200];
+        snprintf(line, sizeof(line), "%-12s %8d %13.0f %9.1f/%-9.1f %9.1f/%-9.1f %11llu",
+                 IPC_TRANSPORT_NAMES[t], workers, seconds > 0 ? burst.total / seconds : 0.0,
+                 histogram_percentile(burst, 50) / 1000.0, histogram_percentile(burst, 99) / 1000.0,
+                 histogram_percentile(single, 50) / 1000.0, histogram_percentile(single, 99) / 1000.0,
+                 static_cast<unsigned long long>(burst.total));
+        std::cout << line << std::endl;
+    }
+
+    munmap(results, resultsSize);
+    cleanup_shared_memory(sd, isMaster);
+    return 0;
+#endif
+}
+
+// Функция для получения пути к исполняемому файлу
+std::string get_executable_path(int argc, char* argv[]) {
+    std::string exePath;
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD len = GetModuleFileNameA(NULL, path, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH) {
+        exePath = "myprogram.exe"; // Запасной вариант
+    }
+    else {
+        exePath = std::string(path);
+    }
+#elif __APPLE__
+    char path[1024];
+    uint32_t size = sizeof(path);
+    if (_NSGetExecutablePath(path, &size) == 0) {
+        char resolved_path[1024];
+        if (realpath(path, resolved_path)) {
+            exePath = std::string(resolved_path);
+        }
+        else {
+            exePath = std::string(path);
+        }
+    }
+    else {
+        exePath = "./myprogram"; // Запасной вариант
+    }
+#else
+    char path[1024];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path)-1);
+    if (len != -1) {
+        path[len] = '\0';
+        exePath = std::string(path);
+    }
+    else {
+        exePath = "./myprogram"; // Запасной вариант
+    }
 #endif
+    return exePath;
 }
 
-// Функция очистки разделяемой памяти
-void cleanup_shared_memory(SharedData* sharedData, bool isMaster) {
+// Сколько копий мастер держит одновременно (--max-copies); 2 - новая пара только после старой
+size_t maxCopies = 2;
+
+// Копии - потоки мастера над тем же SharedData вместо процессов (--threads)
+bool copyThreads = false;
+
+// Копия, запущенная потоком: done, tid и endNs пишет сам поток, мастер читает при сборе
+struct CopyThreadState {
+    std::atomic<bool> done{false};
+    std::atomic<int64_t> tid{0};
+    std::atomic<int64_t> endNs{0}; // Момент завершения: сбор бывает на период спавна позже
+};
+
+struct CopyThread {
+    std::thread thread;
+    int mode;
+    int64_t startNs;
+    std::shared_ptr<CopyThreadState> state;
+};
+
+// Состояние порождённых копий (пункт 5c)
+struct CopyTracker {
+    std::vector<ChildHandle> running;
+    std::vector<CopyThread> threads;
+#ifdef __linux__
+    int epfd = -1; // Цикл событий, в котором ждут pidfd копий
+#endif
+};
+
+// Счётчик пробуждений основного цикла этого процесса
+uint64_t loopWakeups = 0;
+int64_t loopStartNs = 0;
+
+// Функция учёта запущенной копии; её pidfd добавляется в цикл событий
+void track_copy(CopyTracker& copies, const ChildHandle& child) {
+    copies.running.push_back(child);
+#ifdef __linux__
+    if (child.pidfd >= 0 && copies.epfd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = child.pidfd;
+        if (epoll_ctl(copies.epfd, EPOLL_CTL_ADD, child.pidfd, &ev) == -1) {
+            perror("[ERROR] epoll_ctl pidfd");
+        }
+    }
+#endif
+}
+
+// Функция сбора копии без ожидания: true и запись в лог, если копия завершилась
+bool collect_copy(SharedData* sd, ChildHandle& child, bool isMaster) {
+    bool signaled = false;
+    int number = 0;
 #ifdef _WIN32
-    if (sharedData != NULL) {
-        UnmapViewOfFile(sharedData);
+    if (WaitForSingleObject(child.process, 0) != WAIT_OBJECT_0) {
+        return false;
     }
-    // На Windows удаление именованных объектов не требуется, они удаляются автоматически
+    DWORD exitCode = 0;
+    GetExitCodeProcess(child.process, &exitCode);
+    number = static_cast<int>(exitCode);
+    int64_t pid = GetProcessId(child.process);
+    CloseHandle(child.process);
+    child.process = NULL;
 #else
-    if (sharedData && sharedData != MAP_FAILED) {
-        munmap(sharedData, sizeof(SharedData));
+    int status;
+    if (waitpid(child.pid, &status, WNOHANG) != child.pid) {
+        return false;
     }
-    if (isMaster) {
-        // Мастер удаляет разделяемую память при завершении
-        if (shm_unlink(SHM_NAME) == -1) {
-            perror("[ERROR] shm_unlink");
+    signaled = WIFSIGNALED(status);
+    number = signaled ? WTERMSIG(status) : WEXITSTATUS(status);
+    int64_t pid = child.pid;
+    if (child.pidfd >= 0) {
+        close(child.pidfd); // Закрытие снимает pidfd и с epoll
+        child.pidfd = -1;
+    }
+#endif
+    log_event<LEVEL_INFO>(sd, EV_MASTER_COPY_EXITED, pid, (monotonic_ns() - child.startNs) / 1000, isMaster,
+                          copy_exit_code(child.mode, signaled, number));
+    return true;
+}
+
+// Функция сбора завершившихся копий. withPidfd = false - только копий без pidfd:
+// о них сообщает SIGCHLD, а копии с pidfd собираются по событию своего дескриптора
+void reap_copies(SharedData* sd, CopyTracker& copies, bool isMaster, bool withPidfd = true) {
+    auto& running = copies.running;
+    for (size_t i = 0; i < running.size(); ) {
+#ifndef _WIN32
+        if (!withPidfd && running[i].pidfd >= 0) {
+            ++i;
+            continue;
+        }
+#endif
+        if (collect_copy(sd, running[i], isMaster)) {
+            running.erase(running.begin() + i);
         } else {
-            std::cout << "[INFO] Разделяемая память удалена." << std::endl;
+            ++i;
         }
     }
-#endif
 }
 
-// Функция захвата мьютекса
-bool acquire_mutex(SharedData* sd, bool isMaster) {
-#ifdef _WIN32
-    // Открываем именованный мьютекс
-    HANDLE hMutex = OpenMutexA(SYNCHRONIZE, FALSE, MUTEX_NAME);
-    if (hMutex == NULL) {
-        std::cerr << "[ERROR] OpenMutex failed with error: " << GetLastError() << std::endl;
-        return false;
+#ifdef __linux__
+// Функция обработки события pidfd: false - дескриптор не принадлежит копии
+bool handle_copy_pidfd(SharedData* sd, CopyTracker& copies, int fd, bool isMaster) {
+    auto& running = copies.running;
+    for (size_t i = 0; i < running.size(); ++i) {
+        if (running[i].pidfd == fd) {
+            if (collect_copy(sd, running[i], isMaster)) {
+                running.erase(running.begin() + i);
+            }
+            return true;
+        }
     }
-    DWORD dwWaitResult = WaitForSingleObject(hMutex, INFINITE);
-    if (dwWaitResult != WAIT_OBJECT_0) {
-        std::cerr << "[ERROR] WaitForSingleObject failed with error: " << GetLastError() << std::endl;
-        CloseHandle(hMutex);
+    return false;
+}
+#endif
+
+// Функция запуска копии потоком. Копия выполняет ту же run_job, что и процесс-копия:
+// мьютекс счётчика и кольцо лога уже рассчитаны на нескольких писателей, а всё, что
+// принадлежит участнику (слот sharded, отложенное прибавление, TID владельца блокировки), -
+// thread_local, поэтому поток ведёт себя как отдельный процесс без fork и exec
+bool start_copy_thread(SharedData* sd, CopyTracker& copies, int mode, bool isMaster) {
+    CopyThread copy;
+    copy.mode = mode;
+    copy.startNs = monotonic_ns();
+    copy.state = std::make_shared<CopyThreadState>();
+    std::shared_ptr<CopyThreadState> state = copy.state;
+    try {
+        copy.thread = std::thread([sd, mode, isMaster, state]() {
+#ifdef __linux__
+            state->tid.store(cached_thread_id());
+#endif
+            run_job(sd, mode, 2000, 0, isMaster);
+            flush_sloppy_delta(sd, isMaster);
+            release_counter_slot();
+            state->endNs.store(monotonic_ns(), std::memory_order_relaxed);
+            state->done.store(true, std::memory_order_release);
+        });
+    } catch (const std::system_error& e) {
+        std::cerr << "[ERROR] std::thread: " << e.what() << std::endl;
         return false;
     }
-    CloseHandle(hMutex);
+    stats_record(STAT_SPAWN, monotonic_ns() - copy.startNs);
+    copies.threads.push_back(std::move(copy));
     return true;
-#else
-    if (pthread_mutex_lock(&sd->mutex) == 0) {
-        return true;
-    } else {
-        std::cerr << "[ERROR] pthread_mutex_lock failed." << std::endl;
-        return false;
+}
+
+// Функция сбора завершившихся копий-потоков; all = true - дождаться всех (выход мастера)
+void reap_copy_threads(SharedData* sd, CopyTracker& copies, bool isMaster, bool all = false) {
+    auto& threads = copies.threads;
+    for (size_t i = 0; i < threads.size(); ) {
+        if (!all && !threads[i].state->done.load(std::memory_order_acquire)) {
+            ++i;
+            continue;
+        }
+        threads[i].thread.join();
+        const CopyThreadState& state = *threads[i].state;
+        log_event<LEVEL_INFO>(sd, EV_MASTER_COPY_EXITED, state.tid.load(),
+                              (state.endNs.load(std::memory_order_relaxed) - threads[i].startNs) / 1000, isMaster,
+                              copy_exit_code(threads[i].mode, false, 0, true));
+        threads.erase(threads.begin() + i);
+    }
+}
+
+// Пункт 2: увеличение счётчика на 1
+void tick_counter(SharedData* sd, bool isMaster) {
+    int64_t value;
+    if (counter_update(sd, OP_ADD, 1, &value, isMaster)) {
+        // Дополнительный лог для отладки
+        log_event<LEVEL_DEBUG>(sd, EV_DEBUG_TICK, value, 0, isMaster);
+    }
+}
+
+// Пункт 4: запись значения счётчика в лог (только мастер)
+void report_counter(SharedData* sd, bool isMaster) {
+    // Снимок читается без мьютекса и не мешает писателям
+    CounterSnapshot snap;
+    read_counter_snapshot(sd, snap);
+    log_event<LEVEL_INFO>(sd, EV_MASTER_REPORT, snap.value, snap.writerPid, isMaster);
+    if (sloppy_enabled(sd)) {
+        log_event<LEVEL_INFO>(sd, EV_MASTER_STALENESS, sd->sloppyOps, sd->sloppyMs, isMaster);
+    }
+}
+
+// Пункт 5: порождение копий, если предыдущие завершились (только мастер)
+void spawn_copies(SharedData* sd, const std::string& exePath, CopyTracker& copies, bool isMaster) {
+#ifdef __linux__
+    // С пулом копии не порождаются: задания 1 и 2 уходят долгоживущим воркерам
+    if (!workerPool.workers.empty()) {
+        bool queued1 = job_queue_push(sd->jobQueue, 1, 2000);
+        bool queued2 = job_queue_push(sd->jobQueue, 2, 2000);
+        if (queued1 && queued2) {
+            log_event<LEVEL_INFO>(sd, EV_MASTER_POOL_QUEUED, 0, 0, isMaster);
+        }
+        else {
+            log_event<LEVEL_WARN>(sd, EV_MASTER_POOL_FULL, 0, 0, isMaster);
+        }
+        return;
     }
 #endif
+
+    // Собираем завершившиеся копии: каждая известна по дескриптору, проверка точная
+    reap_copies(sd, copies, isMaster);
+    reap_copy_threads(sd, copies, isMaster);
+
+    if (copies.running.size() + copies.threads.size() + 2 <= maxCopies) {
+        bool started1, started2;
+        if (copyThreads) {
+            // Копии 1 и 2 - потоки этого процесса
+            started1 = start_copy_thread(sd, copies, 1, isMaster);
+            started2 = start_copy_thread(sd, copies, 2, isMaster);
+        }
+        else {
+            // Порождать копию 1
+            ChildHandle child1 = spawn_copy(1, exePath);
+            // Порождать копию 2
+            ChildHandle child2 = spawn_copy(2, exePath);
+
+            for (const ChildHandle& child : { child1, child2 }) {
+                if (child_started(child)) {
+                    track_copy(copies, child);
+                }
+            }
+            started1 = child_started(child1);
+            started2 = child_started(child2);
+        }
+        if (started1 && started2) {
+            log_event<LEVEL_INFO>(sd, EV_MASTER_SPAWNED, 0, 0, isMaster);
+        }
+        else {
+            log_event<LEVEL_ERROR>(sd, EV_MASTER_SPAWN_FAILED, 0, 0, isMaster);
+        }
+    }
+    else {
+        // Не можем порождать новые копии
+        log_event<LEVEL_INFO>(sd, EV_MASTER_SPAWN_SKIPPED, 0, 0, isMaster);
+    }
 }
 
-// Функция освобождения мьютекса
-void release_mutex(SharedData* sd, bool isMaster) {
-#ifdef _WIN32
-    // Открываем именованный мьютекс
-    HANDLE hMutex = OpenMutexA(SYNCHRONIZE, FALSE, MUTEX_NAME);
-    if (hMutex != NULL) {
-        if (!ReleaseMutex(hMutex)) {
-            std::cerr << "[ERROR] ReleaseMutex failed with error: " << GetLastError() << std::endl;
+// Функция записи в лог статистики пробуждений основного цикла
+void log_wakeup_stats(SharedData* sd, bool isMaster) {
+    log_event<LEVEL_INFO>(sd, EV_STATS, static_cast<int64_t>(loopWakeups), monotonic_ns() - loopStartNs, isMaster);
+}
+
+// Основной цикл с опросом таймеров каждые 10 мс (платформы без epoll)
+void run_poll_loop(SharedData* sd, const std::string& exePath, bool isMaster) {
+    // Переменные для отслеживания таймеров (пункты 2,4,5)
+    auto last_300ms = std::chrono::steady_clock::now();
+    auto last_1s = std::chrono::steady_clock::now();
+    auto last_3s = std::chrono::steady_clock::now();
+    CopyTracker copies;
+    loopStartNs = monotonic_ns();
+
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        ++loopWakeups;
+
+        // Пункт 2: Каждые 300 мс увеличиваем счётчик на 1
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_300ms).count() >= 300) {
+            last_300ms = now;
+            tick_counter(sd, isMaster);
         }
-        CloseHandle(hMutex);
-    } else {
-        std::cerr << "[ERROR] OpenMutex failed during release with error: " << GetLastError() << std::endl;
+
+        // Пункт 4: Раз в 1 секунду пишем в лог (только мастер)
+        if (isMaster && std::chrono::duration_cast<std::chrono::milliseconds>(now - last_1s).count() >= 1000) {
+            last_1s = now;
+            report_counter(sd, isMaster);
+        }
+
+        // Пункт 5: Раз в 3 секунды порождаем копии
+        if (isMaster && std::chrono::duration_cast<std::chrono::milliseconds>(now - last_3s).count() >= 3000) {
+            last_3s = now;
+            spawn_copies(sd, exePath, copies, isMaster);
+        }
+
+        // Порог sloppyMs проверяется на каждом опросе, а не только при следующем прибавлении
+        flush_sloppy_if_due(sd, isMaster);
+
+        // Пауза короткого времени, чтобы не нагружать CPU
+        sleep_ms(10);
     }
-#else
-    if (pthread_mutex_unlock(&sd->mutex) != 0) {
-        std::cerr << "[ERROR] pthread_mutex_unlock failed." << std::endl;
+    reap_copy_threads(sd, copies, isMaster, true);
+}
+
+#ifdef __linux__
+// Функция блокировки сигналов, которые цикл событий читает через signalfd
+void block_event_loop_signals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);  // Завершение копий
+    sigaddset(&mask, SIGUSR1);  // Запрос статистики пробуждений
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
+// Функция создания периодического таймера timerfd
+int create_interval_timer(int ms) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("[ERROR] timerfd_create");
+        return -1;
     }
-#endif
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = ms / 1000;
+    spec.it_interval.tv_nsec = (ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(fd, 0, &spec, NULL) == -1) {
+        perror("[ERROR] timerfd_settime");
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-// Функция записи в лог-файл с синхронизацией
-void write_log(SharedData* sd, const std::string& msg, bool isMaster) {
-    if (!acquire_mutex(sd, isMaster)) {
-        std::cerr << "[ERROR] Не удалось захватить мьютекс для записи в лог." << std::endl;
-        return;
+// Функция взвода однократного таймера timerfd на момент deadlineNs по CLOCK_MONOTONIC
+bool arm_deadline_timer(int fd, int64_t deadlineNs) {
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = static_cast<time_t>(deadlineNs / 1000000000);
+    spec.it_value.tv_nsec = static_cast<long>(deadlineNs % 1000000000);
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        perror("[ERROR] timerfd_settime");
+        return false;
     }
-    {
-        std::ofstream logFile("log.txt", std::ios::app);
-        if (logFile.is_open()) {
-            logFile << msg << std::endl;
-            logFile.close();
+    return true;
+}
+
+// Функция разбора строк, накопленных из stdin (пункт 3)
+void handle_user_input(SharedData* sd, std::string& pending, bool isMaster) {
+    size_t eol;
+    while ((eol = pending.find('\n')) != std::string::npos) {
+        std::string line = pending.substr(0, eol);
+        pending.erase(0, eol + 1);
+
+        char* end = nullptr;
+        errno = 0;
+        long long new_value = std::strtoll(line.c_str(), &end, 10);
+        while (end != nullptr && (*end == ' ' || *end == '\t' || *end == '\r')) {
+            ++end;
+        }
+        if (line.empty() || end == line.c_str() || *end != '\0' || errno == ERANGE) {
+            std::cout << "Некорректный ввод. Пожалуйста, введите целое число." << std::endl;
         } else {
-            std::cerr << "[ERROR] Не удалось открыть log.txt для записи." << std::endl;
+            apply_user_value(sd, new_value, isMaster);
         }
+        std::cout << "Введите новое значение счётчика: " << std::flush;
     }
-    release_mutex(sd, isMaster);
 }
 
-// Функция запуска копии программы
-bool spawn_copy(int mode, const std::string& exePath) {
-    std::vector<std::string> args_vec = { exePath, "--child", std::to_string(mode) };
-    std::vector<const char*> args;
-    for (const auto& arg : args_vec) {
-        args.push_back(arg.c_str());
+// Функция чтения доступных данных stdin, возвращает false при EOF. Флаги stdin не меняем:
+// O_NONBLOCK лёг бы на общее с оболочкой описание файла. Один read на готовность, а poll
+// без ожидания - на случай, если ввод с того же терминала уже забрал другой процесс
+bool read_user_input(SharedData* sd, std::string& pending, bool isMaster) {
+    struct pollfd ready = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&ready, 1, 0) == 0) {
+        return true;
     }
-    args.push_back(NULL);
+    char buffer[512];
+    ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (n > 0) {
+        pending.append(buffer, n);
+        handle_user_input(sd, pending, isMaster);
+        return true;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return true;
+    }
+    return false;
+}
 
-#ifdef _WIN32
-    // Формируем командную строку
-    std::string cmdLine;
-    for (size_t i = 0; i < args.size() - 1; ++i) { // исключаем NULL
-        cmdLine += args[i];
-        cmdLine += " ";
+// Управляющий сокет мастера (SOCK_SEQPACKET): слушающий сокет и клиенты сидят в общем epoll
+struct ControlServer {
+    int listenFd = -1;
+    std::vector<int> clients;
+    std::vector<ControlCommand> request;
+    std::vector<int64_t> results;
+};
+const char* controlSocketPath = CONTROL_SOCKET_PATH;
+
+// Функция открытия слушающего сокета, возвращает -1 при ошибке
+int open_control_socket(const char* path) {
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "[ERROR] Слишком длинный путь управляющего сокета: " << path << std::endl;
+        return -1;
     }
+    std::strcpy(addr.sun_path, path);
 
-    STARTUPINFOA si;
-    PROCESS_INFORMATION pi;
-    ZeroMemory(&si, sizeof(si));
-    si.cb = sizeof(si);
-    ZeroMemory(&pi, sizeof(pi));
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("[ERROR] socket");
+        return -1;
+    }
+    // Сокет прошлого мастера остаётся в файловой системе; мастер здесь один, так что его можно удалить
+    unlink(path);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+        perror("[ERROR] Не удалось открыть управляющий сокет");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    BOOL success = CreateProcessA(
-        NULL,
-        const_cast<char*>(cmdLine.c_str()),
-        NULL,
-        NULL,
-        FALSE,
-        0,
-        NULL,
-        NULL,
-        &si,
-        &pi
-    );
+// Функция ответа на один пакет команд, возвращает false, если клиента нужно отключить
+bool handle_control_request(SharedData* sd, ControlServer& server, int fd, bool isMaster) {
+    // Один лишний элемент в буфере - чтобы отличить переполненный пакет от полного
+    server.request.resize(CONTROL_MAX_BATCH + 1);
+    ssize_t n = recv(fd, server.request.data(), server.request.size() * sizeof(ControlCommand), MSG_DONTWAIT);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    if (n == 0) {
+        return false; // Клиент закрыл соединение
+    }
 
-    if (!success) {
-        std::cerr << "[ERROR] CreateProcess failed with error: " << GetLastError() << std::endl;
+    size_t count = static_cast<size_t>(n) / sizeof(ControlCommand);
+    ControlReplyHeader header = { CTL_OK, 0 };
+    if (n % sizeof(ControlCommand) != 0 || count > CONTROL_MAX_BATCH) {
+        header.status = CTL_BAD_REQUEST;
+    }
+    for (size_t i = 0; header.status == CTL_OK && i < count; ++i) {
+        if (server.request[i].op > CTL_DIV) {
+            header.status = CTL_BAD_REQUEST;
+        }
+    }
+    server.results.resize(count);
+    if (header.status == CTL_OK) {
+        if (counter_apply_batch(sd, server.request.data(), count, server.results.data(), isMaster)) {
+            header.count = static_cast<uint32_t>(count);
+        } else {
+            header.status = CTL_FAILED;
+        }
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = server.results.data();
+    iov[1].iov_len = header.count * sizeof(int64_t);
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    // Клиент, который не читает ответы, не должен останавливать цикл мастера
+    return sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0;
+}
+
+// Функция обработки события управляющего сокета, возвращает false, если fd ему не принадлежит
+bool handle_control_fd(SharedData* sd, ControlServer& server, int epfd, int fd, bool isMaster) {
+    if (fd < 0) {
         return false;
     }
+    if (fd == server.listenFd) {
+        int client;
+        while ((client = accept4(server.listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = client;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, client, &ev) == -1) {
+                perror("[ERROR] epoll_ctl");
+                close(client);
+                continue;
+            }
+            server.clients.push_back(client);
+        }
+        return true;
+    }
 
-    // Закрываем дескрипторы процесса и потока
-    CloseHandle(pi.hThread);
-    CloseHandle(pi.hProcess);
-    return true;
-#else
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("[ERROR] fork");
+    auto it = std::find(server.clients.begin(), server.clients.end(), fd);
+    if (it == server.clients.end()) {
         return false;
     }
-    if (pid == 0) {
-        // Дочерний процесс
-        execlp(args[0], args[0], args[1], args[2], (char*)NULL);
-        // Если exec не удался
-        perror("[ERROR] execlp");
-        exit(EXIT_FAILURE);
+    if (!handle_control_request(sd, server, fd, isMaster)) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+        close(fd);
+        server.clients.erase(it);
     }
-    // Родительский процесс
     return true;
-#endif
 }
 
-// Функция для режима копии 1
-void run_copy_mode1(SharedData* sd, bool isMaster) {
-    int pid = get_process_id();
-    std::string start_time = get_current_time_string();
-    write_log(sd, "[COPY1] Start: PID=" + std::to_string(pid) + ", time=" + start_time, isMaster);
+// Функция закрытия управляющего сокета и всех клиентов
+void close_control_server(ControlServer& server) {
+    for (int client : server.clients) {
+        close(client);
+    }
+    server.clients.clear();
+    if (server.listenFd >= 0) {
+        close(server.listenFd);
+        unlink(controlSocketPath);
+        server.listenFd = -1;
+    }
+}
+
+// Наблюдение за арендой роли мастера: поток ждёт на futex и перехватывает истёкшую аренду,
+// о перехвате сообщает циклу событий через eventfd. Продлевает аренду сам цикл мастера
+struct LeaseWatcher {
+    int eventFd = -1;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<int32_t> previousOwner{0}; // У кого перехвачена роль
+    std::atomic<int64_t> silenceNs{0};     // Сколько аренда не продлевалась к перехвату
+};
+
+// Функция запуска наблюдения, возвращает eventfd (-1 - перехват выключен или ошибка)
+int start_lease_watcher(SharedData* sd, LeaseWatcher& watcher) {
+    if (sd->lease.leaseMs.load() <= 0) {
+        return -1;
+    }
+    watcher.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher.eventFd < 0) {
+        perror("[ERROR] eventfd");
+        return -1;
+    }
+    watcher.running = true;
+    watcher.thread = std::thread([sd, &watcher]() {
+        MasterLease& lease = sd->lease;
+        int32_t self = cached_process_id();
+        while (watcher.running) {
+            uint32_t epoch = lease.epoch.load(std::memory_order_acquire);
+            int64_t heartbeatNs = lease.heartbeatNs.load(std::memory_order_acquire);
+            int32_t previousOwner;
+            if (lease_try_take_over(lease, self, previousOwner)) {
+                watcher.previousOwner.store(previousOwner);
+                watcher.silenceNs.store(monotonic_ns() - heartbeatNs);
+                uint64_t one = 1;
+                if (write(watcher.eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                    perror("[ERROR] write eventfd");
+                }
+            }
+            lease_wait(lease, epoch);
+        }
+    });
+    return watcher.eventFd;
+}
+
+// Функция остановки наблюдения
+void stop_lease_watcher(LeaseWatcher& watcher) {
+    if (watcher.running) {
+        watcher.running = false;
+        watcher.thread.join();
+    }
+    if (watcher.eventFd >= 0) {
+        close(watcher.eventFd);
+        watcher.eventFd = -1;
+    }
+}
+
+// Основной цикл на epoll: процесс просыпается только когда есть таймер, ввод или сигнал.
+// isMaster меняется, если слейв перехватил аренду роли мастера или мастер её потерял
+void run_event_loop(SharedData* sd, int pid, const std::string& exePath, bool& isMaster) {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("[ERROR] epoll_create1");
+        return;
+    }
 
-    // Увеличиваем счётчик на 10
-    if (acquire_mutex(sd, isMaster)) {
-        sd->counter += 10;
-        release_mutex(sd, isMaster);
+    // Пункты 2, 4, 5: отдельный timerfd на каждый период
+    int tick_fd = create_interval_timer(300);
+    int report_fd = isMaster ? create_interval_timer(1000) : -1;
+    int spawn_fd = isMaster ? create_interval_timer(3000) : -1;
+
+    // Внешние команды над счётчиком принимает только мастер
+    ControlServer control;
+    control.listenFd = isMaster ? open_control_socket(controlSocketPath) : -1;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGUSR1);
+    int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        perror("[ERROR] signalfd");
     }
 
-    // Записываем время завершения и текущее значение счётчика
-    std::string end_time = get_current_time_string();
-    write_log(sd, "[COPY1] End: PID=" + std::to_string(pid)
-                    + ", time=" + end_time
-                    + ", counter=" + std::to_string(sd->counter), isMaster);
-}
+    // Истёкшую аренду роли мастера перехватывает отдельный поток, а продлевает её таймер
+    // самого цикла: если цикл мастера завис, аренда истекает
+    LeaseWatcher leaseWatcher;
+    int lease_fd = start_lease_watcher(sd, leaseWatcher);
+    int renewMs = std::max(1, sd->lease.leaseMs.load() / 4);
+    int renew_fd = isMaster && lease_fd >= 0 ? create_interval_timer(renewMs) : -1;
 
-// Функция для режима копии 2
-void run_copy_mode2(SharedData* sd, bool isMaster) {
-    int pid = get_process_id();
-    std::string start_time = get_current_time_string();
-    write_log(sd, "[COPY2] Start: PID=" + std::to_string(pid) + ", time=" + start_time, isMaster);
+    // Режим sloppy с порогом по времени: таймер взводится, когда у цикла появились
+    // несброшенные прибавления, и сбрасывает их, даже если новых прибавлений не будет
+    int sloppy_fd = -1;
+    bool sloppyArmed = false;
+    if (sd->sloppyMs > 0) {
+        sloppy_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (sloppy_fd < 0) {
+            perror("[ERROR] timerfd_create");
+        }
+    }
 
-    // Умножаем счётчик на 2
-    if (acquire_mutex(sd, isMaster)) {
-        sd->counter *= 2;
-        release_mutex(sd, isMaster);
+    auto watch_fd = [epfd](int fd) {
+        if (fd < 0) {
+            return;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("[ERROR] epoll_ctl");
+        }
+    };
+    for (int fd : { tick_fd, report_fd, spawn_fd, signal_fd, control.listenFd, lease_fd, renew_fd, sloppy_fd }) {
+        watch_fd(fd);
     }
 
-    // Ждём 2 секунды
-    sleep_ms(2000);
+    // Смена роли по аренде: мастер держит таймеры пунктов 4 и 5, управляющий сокет и
+    // перенос лога в файл; пул воркеров остаётся только у мастера, запустившего его
+    auto switch_role = [&](bool master) {
+        isMaster = master;
+        if (master) {
+            report_fd = create_interval_timer(1000);
+            spawn_fd = create_interval_timer(3000);
+            renew_fd = create_interval_timer(renewMs);
+            control.listenFd = open_control_socket(controlSocketPath);
+            for (int fd : { report_fd, spawn_fd, renew_fd, control.listenFd }) {
+                watch_fd(fd);
+            }
+            start_log_drainer(sd, isMaster);
+            int64_t silenceNs = leaseWatcher.silenceNs.load();
+            std::cout << "[INFO] Процесс " << pid << " стал Мастером: аренда не продлевалась "
+                      << silenceNs / 1000000.0 << " мс." << std::endl;
+            log_event<LEVEL_WARN>(sd, EV_MASTER_TAKEOVER, leaseWatcher.previousOwner.load(), silenceNs / 1000, isMaster);
+            return;
+        }
+        log_event<LEVEL_WARN>(sd, EV_MASTER_DEMOTED, lease_owner(sd->lease.owner.load()), 0, isMaster);
+        std::cout << "[INFO] Процесс " << pid << " больше не Мастер." << std::endl;
+        // Закрытие снимает дескрипторы и с epoll. Файл сокета теперь принадлежит новому мастеру
+        for (int* fd : { &report_fd, &spawn_fd, &renew_fd, &control.listenFd }) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        for (int client : control.clients) {
+            close(client);
+        }
+        control.clients.clear();
+        stop_log_drainer();
+    };
 
-    // Делим счётчик на 2
-    if (acquire_mutex(sd, isMaster)) {
-        sd->counter /= 2;
-        release_mutex(sd, isMaster);
+    // Пункт 3: stdin - ещё один источник событий вместо отдельного потока
+    std::string pending;
+    std::cout << "Введите новое значение счётчика: " << std::flush;
+    struct epoll_event stdin_ev;
+    stdin_ev.events = EPOLLIN;
+    stdin_ev.data.fd = STDIN_FILENO;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &stdin_ev) == -1) {
+        // Обычный файл нельзя добавить в epoll, но он и не блокирует чтение
+        if (errno == EPERM) {
+            while (read_user_input(sd, pending, isMaster)) {
+            }
+        }
     }
 
-    // Записываем время завершения и текущее значение счётчика
-    std::string end_time = get_current_time_string();
-    write_log(sd, "[COPY2] End: PID=" + std::to_string(pid)
-                    + ", time=" + end_time
-                    + ", counter=" + std::to_string(sd->counter), isMaster);
-}
+    CopyTracker copies;
+    copies.epfd = epfd;
+    loopStartNs = monotonic_ns();
 
-// Функция для обработки пользовательского ввода
-void user_input_thread_func(SharedData* sd, std::atomic<bool>& running, bool isMaster) {
-    while (running) {
-        std::cout << "Введите новое значение счётчика: ";
-        int new_value;
-        std::cin >> new_value;
-        if (std::cin.fail()) {
-            std::cin.clear(); // Сброс состояния ошибки
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Игнорирование некорректного ввода
-            std::cout << "Некорректный ввод. Пожалуйста, введите целое число." << std::endl;
-            continue;
+    while (true) {
+        struct epoll_event events[8];
+        int n = epoll_wait(epfd, events, 8, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[ERROR] epoll_wait");
+            break;
+        }
+        ++loopWakeups;
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == STDIN_FILENO) {
+                if (!read_user_input(sd, pending, isMaster)) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+                }
+                continue;
+            }
+            if (fd == signal_fd) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGCHLD) {
+                        reap_workers(sd, isMaster);
+                        reap_copies(sd, copies, isMaster, false);
+                    } else if (info.ssi_signo == SIGUSR1) {
+                        log_wakeup_stats(sd, isMaster);
+                    }
+                }
+                continue;
+            }
+            if (fd == lease_fd) {
+                uint64_t count;
+                if (read(lease_fd, &count, sizeof(count)) == sizeof(count)) {
+                    if (!isMaster && lease_owner(sd->lease.owner.load()) == cached_process_id()) {
+                        switch_role(true);
+                    }
+                }
+                continue;
+            }
+            if (handle_copy_pidfd(sd, copies, fd, isMaster)) {
+                continue;
+            }
+            if (handle_control_fd(sd, control, epfd, fd, isMaster)) {
+                continue;
+            }
+
+            // Сбрасываем счётчик срабатываний; пропущенные периоды не догоняем, как и раньше
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;
+            }
+            if (fd == sloppy_fd) {
+                sloppyArmed = false;
+                flush_sloppy_if_due(sd, isMaster);
+            } else if (fd == renew_fd) {
+                // Пока цикл стоял, роль могли перехватить: тогда мастер уступает её
+                if (!lease_renew(sd->lease, cached_process_id())) {
+                    switch_role(false);
+                }
+            } else if (fd == tick_fd) {
+                tick_counter(sd, isMaster);
+            } else if (fd == report_fd) {
+                report_counter(sd, isMaster);
+            } else if (fd == spawn_fd) {
+                spawn_copies(sd, exePath, copies, isMaster);
+            }
         }
 
-        // Устанавливаем новое значение счётчика
-        if (acquire_mutex(sd, isMaster)) {
-            sd->counter = new_value;
-            release_mutex(sd, isMaster);
+        int64_t sloppyDeadlineNs = sloppy_fd >= 0 ? sloppy_flush_deadline(sd) : 0;
+        if (sloppyDeadlineNs != 0 && !sloppyArmed) {
+            sloppyArmed = arm_deadline_timer(sloppy_fd, sloppyDeadlineNs);
         }
+    }
 
-        // Записываем изменение в лог
-        std::string msg = "[USER] Установлено новое значение счётчика: " + std::to_string(new_value)
-                        + " | PID=" + std::to_string(get_process_id())
-                        + " | time=" + get_current_time_string();
-        write_log(sd, msg, isMaster);
+    reap_copy_threads(sd, copies, isMaster, true);
+    stop_lease_watcher(leaseWatcher);
+    close_control_server(control);
+    for (int fd : { tick_fd, report_fd, spawn_fd, renew_fd, sloppy_fd, signal_fd, epfd }) {
+        if (fd >= 0) {
+            close(fd);
+        }
     }
 }
+#endif
 
-// Функция для получения пути к исполняемому файлу
-std::string get_executable_path(int argc, char* argv[]) {
-    std::string exePath;
-#ifdef _WIN32
-    char path[MAX_PATH];
-    DWORD len = GetModuleFileNameA(NULL, path, MAX_PATH);
-    if (len == 0 || len >= MAX_PATH) {
-        exePath = "myprogram.exe"; // Запасной вариант
-    }
-    else {
-        exePath = std::string(path);
+#ifdef __linux__
+// Подписка на изменения для цикла epoll: futex нельзя добавить в epoll, поэтому поток
+// ждёт в wait_for_change и сигналит в eventfd, который цикл уже умеет ждать
+struct ChangeNotifier {
+    int eventFd = -1;
+    std::thread thread;
+    std::atomic<bool> running{false};
+};
+
+// Функция запуска подписки, возвращает eventfd (-1 - ошибка)
+int start_change_notifier(SharedData* sd, ChangeNotifier& notifier) {
+    notifier.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notifier.eventFd < 0) {
+        perror("[ERROR] eventfd");
+        return -1;
     }
-#elif __APPLE__
-    char path[1024];
-    uint32_t size = sizeof(path);
-    if (_NSGetExecutablePath(path, &size) == 0) {
-        char resolved_path[1024];
-        if (realpath(path, resolved_path)) {
-            exePath = std::string(resolved_path);
-        }
-        else {
-            exePath = std::string(path);
+    notifier.running = true;
+    notifier.thread = std::thread([sd, &notifier]() {
+        uint32_t seq = sd->snapshot.seq.load(std::memory_order_acquire);
+        while (notifier.running) {
+            // Таймаут только чтобы заметить остановку подписки
+            if (wait_for_change(sd, seq, 200, seq)) {
+                uint64_t one = 1;
+                if (write(notifier.eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                    perror("[ERROR] write eventfd");
+                }
+            }
         }
+    });
+    return notifier.eventFd;
+}
+
+// Функция остановки подписки
+void stop_change_notifier(ChangeNotifier& notifier) {
+    if (notifier.running) {
+        notifier.running = false;
+        notifier.thread.join();
     }
-    else {
-        exePath = "./myprogram"; // Запасной вариант
+    if (notifier.eventFd >= 0) {
+        close(notifier.eventFd);
+        notifier.eventFd = -1;
     }
-#else
-    char path[1024];
-    ssize_t len = readlink("/proc/self/exe", path, sizeof(path)-1);
-    if (len != -1) {
-        path[len] = '\0';
-        exePath = std::string(path);
+}
+
+// Режим наблюдателя (--watch): печатает каждое изменение счётчика и задержку от
+// публикации до того, как наблюдатель его увидел. Завершается по SIGINT/SIGTERM
+void run_watch(SharedData* sd) {
+    ChangeNotifier notifier;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    int event_fd = start_change_notifier(sd, notifier);
+    for (int fd : { event_fd, signal_fd }) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (fd < 0 || epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("[ERROR] Наблюдатель не запущен");
+            stop_change_notifier(notifier);
+            return;
+        }
     }
-    else {
-        exePath = "./myprogram"; // Запасной вариант
+
+    bool running = true;
+    while (running) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epfd, events, 2, -1);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == signal_fd) {
+                running = false;
+                continue;
+            }
+            uint64_t count;
+            if (read(event_fd, &count, sizeof(count)) != sizeof(count)) {
+                continue;
+            }
+            CounterSnapshot snap;
+            read_counter_snapshot(sd, snap);
+            std::cout << "[WATCH] counter=" << snap.value << ", writer=" << snap.writerPid
+                      << ", задержка " << (realtime_ns() - snap.updateNs) / 1000.0 << " мкс" << std::endl;
+        }
     }
+
+    stop_change_notifier(notifier);
+    close(signal_fd);
+    close(epfd);
+}
 #endif
-    return exePath;
+
+#ifndef _WIN32
+// Функция сброса кэшированного состояния процесса в потомке после fork
+void reset_process_state_after_fork() {
+    cachedPid = 0;
+#ifdef __linux__
+    cachedTid = 0;
+#endif
+    mySlot = nullptr; // Слот родителя не наследуем
+    myStats = nullptr; // Гистограммы родителя тоже: потомок без своего слота их не пишет
+    sloppy = SloppyDelta(); // Несброшенные прибавления родителя сбросит сам родитель
 }
+#endif
 
 int main(int argc, char* argv[]) {
+#ifndef _WIN32
+    pthread_atfork(NULL, NULL, reset_process_state_after_fork);
+#endif
+
     // Проверяем, является ли процесс копией
     bool isChild = false;
     int childMode = 0;
@@ -494,214 +5363,309 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    // Инициализируем разделяемую память
+#ifndef _WIN32
+    // Сегмент и лог можно переопределить окружением (так их получают порождённые процессы)
+    if (const char* name = getenv("HW3_SHM_NAME")) {
+        SHM_NAME = name;
+    }
+    if (const char* name = getenv("HW3_LOG_FILE")) {
+        LOG_FILE = name;
+    }
+    if (const char* name = getenv("HW3_LOG_BIN_FILE")) {
+        LOG_BIN_FILE = name;
+    }
+#endif
+#ifdef __linux__
+    if (const char* name = getenv("HW3_CONTROL_SOCKET")) {
+        controlSocketPath = name;
+    }
+#endif
+
+    // Разбираем дополнительные параметры
+    MasterSettings settings;
+    bool isWorker = false;
+    bool watchMode = false;
+    int poolSize = 0;
+    int holdMs = 2000;
+    int64_t submitNs = 0;
+    bool benchCounter = false;
+    bool benchTopology = false;
+    bool benchPool = false;
+    bool benchLog = false;
+    bool benchRegistry = false;
+    bool benchArena = false;
+    bool benchPersist = false;
+    bool benchTxn = false;
+    bool benchNotify = false;
+    bool benchIpc = false;
+    bool benchSloppy = false;
+    bool benchTimefmt = false;
+    bool benchFailover = false;
+    int benchJobs = 500;
+    int benchProcs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int benchOps = 200000;
+    // По умолчанию - смесь операций программы: +1, +10, *2 и /2
+    int benchMix[BENCH_OP_COUNT] = { 1, 1, 1, 0 };
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            if (!parse_backend(argv[++i], settings.backend)) {
+                std::cerr << "[ERROR] Неизвестный способ синхронизации: " << argv[i]
+                          << " (ожидается mutex, atomic, sharded, futex или optimistic)" << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--log-format") == 0 && i + 1 < argc) {
+            const char* format = argv[++i];
+            if (std::strcmp(format, "text") == 0 || std::strcmp(format, "binary") == 0) {
+                settings.binaryLog = std::strcmp(format, "binary") == 0;
+            }
+            else {
+                std::cerr << "[ERROR] Неизвестный формат лога: " << format
+                          << " (ожидается text или binary)" << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            if (!parse_log_level(argv[++i], settings.logLevel)) {
+                std::cerr << "[ERROR] Неизвестный уровень лога: " << argv[i]
+                          << " (ожидается debug, info, warn или error)" << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--log-rotate-size") == 0 && i + 1 < argc) {
+            logRotation.maxBytes = std::max(0LL, std::atoll(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--log-rotate-interval") == 0 && i + 1 < argc) {
+            logRotation.intervalSec = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--log-keep") == 0 && i + 1 < argc) {
+            logRotation.keep = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--sloppy-ops") == 0 && i + 1 < argc) {
+            settings.sloppyOps = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--sloppy-ms") == 0 && i + 1 < argc) {
+            settings.sloppyMs = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--lease-ms") == 0 && i + 1 < argc) {
+            settings.leaseMs = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--persist") == 0 && i + 1 < argc) {
+            settings.persistPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--max-copies") == 0 && i + 1 < argc) {
+            maxCopies = static_cast<size_t>(std::max(2, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0) {
+            copyThreads = true;
+        }
+#ifdef __linux__
+        else if (std::strcmp(argv[i], "--control-socket") == 0 && i + 1 < argc) {
+            controlSocketPath = argv[++i];
+        }
+#endif
+        else if (std::strcmp(argv[i], "--watch") == 0) {
+            watchMode = true;
+        }
+        else if (std::strcmp(argv[i], "--worker") == 0) {
+            isWorker = true;
+        }
+        else if (std::strcmp(argv[i], "--pool") == 0 && i + 1 < argc) {
+            poolSize = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--hold") == 0 && i + 1 < argc) {
+            holdMs = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--submit-ns") == 0 && i + 1 < argc) {
+            submitNs = std::atoll(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--bench-counter") == 0) {
+            benchCounter = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-topology") == 0) {
+            benchTopology = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-pool") == 0) {
+            benchPool = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-log") == 0) {
+            benchLog = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-registry") == 0) {
+            benchRegistry = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-arena") == 0) {
+            benchArena = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-persist") == 0) {
+            benchPersist = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-txn") == 0) {
+            benchTxn = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-notify") == 0) {
+            benchNotify = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-ipc") == 0) {
+            benchIpc = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-sloppy") == 0) {
+            benchSloppy = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-timefmt") == 0) {
+            benchTimefmt = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-failover") == 0) {
+            benchFailover = true;
+        }
+        else if (std::strcmp(argv[i], "--bench-jobs") == 0 && i + 1 < argc) {
+            benchJobs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--bench-procs") == 0 && i + 1 < argc) {
+            benchProcs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--bench-ops") == 0 && i + 1 < argc) {
+            benchOps = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--bench-mix") == 0 && i + 1 < argc) {
+            if (!parse_bench_mix(argv[++i], benchMix)) {
+                std::cerr << "[ERROR] Некорректная смесь операций: " << argv[i]
+                          << " (пример: add1:50,add10:20,muldiv:20,set:10)" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (benchCounter || benchTopology) {
+        return run_counter_benchmark(benchProcs, benchOps, benchMix, benchTopology);
+    }
+    if (benchTxn) {
+        return run_txn_benchmark(benchProcs, benchOps);
+    }
+    if (benchSloppy) {
+        return run_sloppy_benchmark(benchProcs, benchOps);
+    }
+    if (benchTimefmt) {
+        return run_timefmt_benchmark(benchProcs, benchOps);
+    }
+    if (benchFailover) {
+        // Раунд длится порядка срока аренды, поэтому число раундов ограничено.
+        // Аренда по умолчанию выключена; для замера без --lease-ms берём 300 мс
+        return run_failover_benchmark(benchProcs, std::min(benchJobs, 20), settings.leaseMs > 0 ? settings.leaseMs : 300);
+    }
+    if (benchIpc) {
+        return run_ipc_benchmark(benchProcs, benchOps);
+    }
+    if (benchNotify) {
+        // Изменения разнесены на 1 мс, поэтому число операций ограничено
+        return run_notify_benchmark(std::min(benchOps, 2000));
+    }
+    if (benchPersist) {
+        return run_persist_benchmark(benchOps);
+    }
+    if (benchArena) {
+        return run_arena_benchmark(benchProcs, benchOps);
+    }
+    if (benchRegistry) {
+        return run_registry_benchmark(benchProcs, benchOps);
+    }
+    if (benchLog) {
+        return run_log_benchmark(benchOps);
+    }
+    if (benchPool) {
+        return run_pool_benchmark(get_executable_path(argc, argv), poolSize > 0 ? poolSize : benchProcs, benchJobs);
+    }
+
+    // Роль процесса в инспекторе статистики
+    std::string role = isChild ? "copy" + std::to_string(childMode) : "";
+    if (isWorker) {
+        role = "worker";
+    } else if (watchMode) {
+        role = "watch";
+    }
+    statsRole = role.empty() ? nullptr : role.c_str();
+
+    // Инициализируем разделяемую память (способ синхронизации задаёт только мастер)
     SharedData* sharedData = nullptr;
     bool isMaster = false;
-    if (!initialize_shared_memory(&sharedData, isMaster)) {
+    if (!initialize_shared_memory(&sharedData, isMaster, settings)) {
         std::cerr << "[ERROR] Не удалось инициализировать разделяемую память." << std::endl;
         return 1;
     }
 
-    // Получаем PID
-    int pid = get_process_id();
+#ifdef __linux__
+    // Наблюдатель только подписывается на изменения и не участвует в протоколе
+    if (watchMode) {
+        if (isMaster) {
+            std::cerr << "[ERROR] Мастер не запущен, наблюдать не за чем." << std::endl;
+        } else {
+            run_watch(sharedData);
+        }
+        cleanup_shared_memory(sharedData, isMaster);
+        return isMaster ? 1 : 0;
+    }
+#endif
+
+#ifdef __linux__
+    // Сигналы цикла событий блокируем до запуска потоков, чтобы маску унаследовали все
+    block_event_loop_signals();
+#endif
+
+    // Мастер переносит лог-записи всех процессов из разделяемой памяти в log.txt
+    start_log_drainer(sharedData, isMaster);
 
     // Записываем строку о запуске в лог (пункт 1)
-    std::string start_time = get_current_time_string();
-    std::string role = isMaster ? "MASTER" : "SLAVE";
-    std::string start_msg = "[MAIN] Start: PID=" + std::to_string(pid)
-                           + ", time=" + start_time
-                           + " (" + role + ")";
-    write_log(sharedData, start_msg, isMaster);
+    log_event<LEVEL_INFO>(sharedData, EV_MAIN_START, isMaster ? 1 : 0, 0, isMaster);
 
     // Если процесс является копией, выполняем соответствующий режим и завершаемся
     if (isChild) {
-        if (childMode == 1) {
-            run_copy_mode1(sharedData, isMaster);
-        }
-        else if (childMode == 2) {
-            run_copy_mode2(sharedData, isMaster);
-        }
+        run_job(sharedData, childMode, holdMs, submitNs, isMaster);
+        stop_log_drainer();
         cleanup_shared_memory(sharedData, isMaster);
         return 0;
     }
 
-    // Запускаем поток для обработки пользовательского ввода (пункт 3)
-    std::atomic<bool> running(true);
-    std::thread inputThread(user_input_thread_func, sharedData, std::ref(running), isMaster);
+#ifdef __linux__
+    // Воркер пула разбирает задания, пока мастер не остановит пул
+    if (isWorker) {
+        run_pool_worker(sharedData);
+        stop_log_drainer();
+        cleanup_shared_memory(sharedData, isMaster);
+        return 0;
+    }
+#endif
 
     // Определяем путь к исполняемому файлу для порождения копий
     std::string exePath = get_executable_path(argc, argv);
     if (exePath.empty()) {
         std::cerr << "[ERROR] Не удалось определить путь к исполняемому файлу." << std::endl;
-        running = false;
-        inputThread.join();
+        stop_log_drainer();
         cleanup_shared_memory(sharedData, isMaster);
         return 1;
     }
 
-    // Переменные для отслеживания таймеров (пункты 2,4,5)
-    auto last_300ms = std::chrono::steady_clock::now();
-    auto last_1s = std::chrono::steady_clock::now();
-    auto last_3s = std::chrono::steady_clock::now();
-
-    // Переменные для отслеживания состояния копий (пункт 5c)
-#ifdef _WIN32
-    HANDLE child1Handle = NULL;
-    HANDLE child2Handle = NULL;
-#else
-    bool child1Active = false;
-    bool child2Active = false;
-    pid_t childPID1 = -1;
-    pid_t childPID2 = -1;
-#endif
-
-    // Основной цикл программы
-    while (true) {
-        auto now = std::chrono::steady_clock::now();
-
-        // Пункт 2: Каждые 300 мс увеличиваем счётчик на 1
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_300ms).count() >= 300) {
-            last_300ms = now;
-            if (acquire_mutex(sharedData, isMaster)) {
-                sharedData->counter += 1;
-                release_mutex(sharedData, isMaster);
-                // Дополнительный лог для отладки
-                std::string debug_msg = "[DEBUG] PID=" + std::to_string(pid)
-                                      + " увеличил счётчик до " + std::to_string(sharedData->counter);
-                write_log(sharedData, debug_msg, isMaster);
-            }
-        }
-
-        // Пункт 4: Раз в 1 секунду пишем в лог (только мастер)
-        if (isMaster && std::chrono::duration_cast<std::chrono::milliseconds>(now - last_1s).count() >= 1000) {
-            last_1s = now;
-            std::string current_time = get_current_time_string();
-            int current_counter;
-            if (acquire_mutex(sharedData, isMaster)) {
-                current_counter = sharedData->counter;
-                release_mutex(sharedData, isMaster);
-            } else {
-                current_counter = -1; // Ошибка
-            }
-            std::string log_msg = "[MASTER] " + current_time
-                                 + " PID=" + std::to_string(pid)
-                                 + ", counter=" + std::to_string(current_counter);
-            write_log(sharedData, log_msg, isMaster);
-        }
-
-        // Пункт 5: Раз в 3 секунды порождаем копии
-        if (isMaster && std::chrono::duration_cast<std::chrono::milliseconds>(now - last_3s).count() >= 3000) {
-            last_3s = now;
-            bool canSpawn = true;
-
-#ifdef _WIN32
-            // Проверяем, завершились ли предыдущие копии
-            if (child1Handle != NULL) {
-                DWORD waitRes = WaitForSingleObject(child1Handle, 0);
-                if (waitRes == WAIT_TIMEOUT) {
-                    // Копия 1 ещё работает
-                    canSpawn = false;
-                }
-                else {
-                    // Копия 1 завершилась
-                    CloseHandle(child1Handle);
-                    child1Handle = NULL;
-                }
-            }
-
-            if (child2Handle != NULL) {
-                DWORD waitRes = WaitForSingleObject(child2Handle, 0);
-                if (waitRes == WAIT_TIMEOUT) {
-                    // Копия 2 ещё работает
-                    canSpawn = false;
-                }
-                else {
-                    // Копия 2 завершилась
-                    CloseHandle(child2Handle);
-                    child2Handle = NULL;
-                }
-            }
-#else
-            // Проверяем, завершились ли предыдущие копии
-            if (child1Active) {
-                int status;
-                pid_t result = waitpid(childPID1, &status, WNOHANG);
-                if (result == 0) {
-                    // Копия 1 ещё работает
-                    canSpawn = false;
-                }
-                else if (result == childPID1) {
-                    // Копия 1 завершилась
-                    child1Active = false;
-                }
-                else {
-                    // Ошибка
-                    perror("[ERROR] waitpid для копии 1");
-                    child1Active = false;
-                }
-            }
-
-            if (child2Active) {
-                int status;
-                pid_t result = waitpid(childPID2, &status, WNOHANG);
-                if (result == 0) {
-                    // Копия 2 ещё работает
-                    canSpawn = false;
-                }
-                else if (result == childPID2) {
-                    // Копия 2 завершилась
-                    child2Active = false;
-                }
-                else {
-                    // Ошибка
-                    perror("[ERROR] waitpid для копии 2");
-                    child2Active = false;
-                }
-            }
-#endif
-
-            if (canSpawn) {
-                // Порождать копию 1
-                bool spawned1 = spawn_copy(1, exePath);
-                // Порождать копию 2
-                bool spawned2 = spawn_copy(2, exePath);
+#ifdef __linux__
+    // Пункт 5 через пул: копии заменяются долгоживущими воркерами
+    if (isMaster && poolSize > 0 && !start_worker_pool(sharedData, exePath, poolSize)) {
+        std::cerr << "[ERROR] Не удалось запустить пул воркеров." << std::endl;
+    }
 
-                if (spawned1 && spawned2) {
-                    std::string msg = "[MASTER] Запущены копии 1 и 2.";
-                    write_log(sharedData, msg, isMaster);
-#ifdef _WIN32
-                    // На Windows сложно отслеживать процессы без сохранения HANDLE
-                    // Поэтому не сохраняем дескрипторы копий
+    // Таймеры, ввод пользователя (пункт 3) и завершение копий обрабатываются одним epoll-циклом
+    int pid = get_process_id();
+    run_event_loop(sharedData, pid, exePath, isMaster);
+    stop_worker_pool(sharedData);
 #else
-                    // На POSIX сохраняем PID копий
-                    // В текущей реализации функция spawn_copy не возвращает PID, поэтому устанавливаем активность
-                    child1Active = true;
-                    childPID1 = -1; // Не знаем PID
-                    child2Active = true;
-                    childPID2 = -1; // Не знаем PID
-#endif
-                }
-                else {
-                    std::string msg = "[MASTER] Не удалось запустить копии.";
-                    write_log(sharedData, msg, isMaster);
-                }
-            }
-            else {
-                // Не можем порождать новые копии
-                std::string current_time = get_current_time_string();
-                std::string msg = "[MASTER] " + current_time
-                                + " Некоторые копии ещё работают. Пропуск запуска новых копий.";
-                write_log(sharedData, msg, isMaster);
-            }
-        }
+    // Запускаем поток для обработки пользовательского ввода (пункт 3)
+    std::atomic<bool> running(true);
+    std::thread inputThread(user_input_thread_func, sharedData, std::ref(running), isMaster);
 
-        // Пауза короткого времени, чтобы не нагружать CPU
-        sleep_ms(10);
-    }
+    run_poll_loop(sharedData, exePath, isMaster);
 
-    // Теоретически сюда не дойдём (вечный цикл)
     running = false;
     inputThread.join();
+#endif
+
+    stop_log_drainer();
     cleanup_shared_memory(sharedData, isMaster);
 
     return 0;
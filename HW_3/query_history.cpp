@@ -0,0 +1,208 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+
+#include "event_log.h"
+#include "counter_history.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifndef _WIN32
+// Функция отображения сегмента истории только для чтения
+const HistorySegment* map_history_segment(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        perror(("[ERROR] shm_open " + name).c_str());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(HistorySegment)) {
+        std::cerr << "[ERROR] " << name << " не является историей счётчика HW_3" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    void* addr = mmap(NULL, sizeof(HistorySegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("[ERROR] mmap");
+        return nullptr;
+    }
+    const HistorySegment* history = static_cast<const HistorySegment*>(addr);
+    if (std::memcmp(history->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0
+        || history->capacity != HISTORY_CAPACITY) {
+        std::cerr << "[ERROR] Формат " << name << " не совпадает с этой сборкой" << std::endl;
+        munmap(addr, sizeof(HistorySegment));
+        return nullptr;
+    }
+    return history;
+}
+
+// Функция разбора времени: наносекунды от эпохи или "YYYY-MM-DD HH:MM:SS[.мс]" местного времени
+bool parse_time(const char* text, int64_t& timeNs) {
+    char* end = nullptr;
+    long long ns = std::strtoll(text, &end, 10);
+    if (end != text && *end == '\0') {
+        timeNs = ns;
+        return true;
+    }
+    struct tm tm_time;
+    std::memset(&tm_time, 0, sizeof(tm_time));
+    const char* rest = strptime(text, "%Y-%m-%d %H:%M:%S", &tm_time);
+    if (rest == nullptr) {
+        return false;
+    }
+    tm_time.tm_isdst = -1;
+    int64_t fraction = 0;
+    if (*rest == '.') {
+        int64_t scale = 100000000;
+        for (++rest; *rest >= '0' && *rest <= '9'; ++rest, scale /= 10) {
+            fraction += (*rest - '0') * scale;
+        }
+    }
+    if (*rest != '\0') {
+        return false;
+    }
+    timeNs = static_cast<int64_t>(mktime(&tm_time)) * 1000000000LL + fraction;
+    return true;
+}
+
+// Функция чтения записи для поиска: 0 - прочитана, -1 - уже затёрта (старше окна),
+// 1 - ещё не записана (новее всего прочитанного)
+int probe(const HistorySegment* history, uint64_t pos, HistoryRecord& rec) {
+    if (history_read(history, pos, rec)) {
+        return 0;
+    }
+    uint64_t seq = history->entries[pos & (HISTORY_CAPACITY - 1)].seq.load(std::memory_order_acquire);
+    return seq > 2 * pos + 2 ? -1 : 1;
+}
+
+// Функция двоичного поиска первой позиции в [lo, hi), чья запись позже timeNs
+// (или не раньше - при inclusive)
+uint64_t find_after(const HistorySegment* history, uint64_t lo, uint64_t hi, int64_t timeNs, bool inclusive) {
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        HistoryRecord rec;
+        int state = probe(history, mid, rec);
+        bool after = state > 0 || (state == 0 && (inclusive ? rec.timeNs >= timeNs : rec.timeNs > timeNs));
+        if (after) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+// Функция печати записи
+void print_record(const HistoryRecord& rec) {
+    char line[160];
+    snprintf(line, sizeof(line), "%s%06lld  value=%lld  pid=%d  op=%s", format_time_ns(rec.timeNs).c_str(),
+             static_cast<long long>(rec.timeNs % 1000000), static_cast<long long>(rec.value), rec.pid,
+             history_op_name(rec.op));
+    std::cout << line << '\n';
+}
+#endif
+
+// Запросы к истории счётчика HW_3 (сегмент <SHM_NAME>_history, только чтение).
+//   query_history [--shm NAME] --at TIME         - значение на момент TIME
+//   query_history [--shm NAME] --range T1 T2     - изменения в интервале [T1, T2]
+//   query_history [--shm NAME] --tail N          - последние N изменений
+// TIME - наносекунды от эпохи или "YYYY-MM-DD HH:MM:SS[.мс]", как в log.txt
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    std::cerr << "[ERROR] История поддерживается только на POSIX." << std::endl;
+    return 1;
+#else
+    std::string shmName = getenv("HW3_SHM_NAME") ? getenv("HW3_SHM_NAME") : "/mysharedmemory";
+    enum { QUERY_NONE, QUERY_AT, QUERY_RANGE, QUERY_TAIL } query = QUERY_NONE;
+    int64_t from = 0, to = 0;
+    uint64_t tail = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shmName = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--at") == 0 && i + 1 < argc) {
+            query = QUERY_AT;
+            if (!parse_time(argv[++i], from)) {
+                std::cerr << "[ERROR] Некорректное время: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--range") == 0 && i + 2 < argc) {
+            query = QUERY_RANGE;
+            if (!parse_time(argv[i + 1], from) || !parse_time(argv[i + 2], to)) {
+                std::cerr << "[ERROR] Некорректный интервал: " << argv[i + 1] << " " << argv[i + 2] << std::endl;
+                return 1;
+            }
+            i += 2;
+        }
+        else if (std::strcmp(argv[i], "--tail") == 0 && i + 1 < argc) {
+            query = QUERY_TAIL;
+            tail = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            std::cerr << "[ERROR] Неизвестный параметр: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (query == QUERY_NONE) {
+        std::cerr << "[ERROR] Нужен запрос: --at TIME, --range T1 T2 или --tail N" << std::endl;
+        return 1;
+    }
+
+    const HistorySegment* history = map_history_segment(shmName + "_history");
+    if (history == nullptr) {
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t head = history->head.load(std::memory_order_acquire);
+    uint64_t oldest = head > HISTORY_CAPACITY ? head - HISTORY_CAPACITY : 0;
+    size_t printed = 0;
+    HistoryRecord rec;
+    if (query == QUERY_AT) {
+        uint64_t pos = find_after(history, oldest, head, from, false);
+        if (pos > oldest && probe(history, pos - 1, rec) == 0) {
+            print_record(rec);
+            printed = 1;
+        } else {
+            std::cerr << "[INFO] На этот момент записей нет: он раньше начала истории." << std::endl;
+        }
+    } else {
+        uint64_t pos = query == QUERY_TAIL ? (head - oldest > tail ? head - tail : oldest)
+                                           : find_after(history, oldest, head, from, true);
+        for (; pos < head; ++pos) {
+            int state = probe(history, pos, rec);
+            if (state > 0) {
+                continue; // Ещё не готова или пропущена писателем - выводим готовые
+            }
+            if (state < 0) {
+                continue; // Затёрта, пока мы читали: переходим к более новым
+            }
+            if (query == QUERY_RANGE && rec.timeNs > to) {
+                break;
+            }
+            print_record(rec);
+            ++printed;
+        }
+    }
+    std::cout.flush();
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "[INFO] " << printed << " записей из " << head - oldest << " в истории, запрос за "
+              << micros << " мкс" << std::endl;
+
+    munmap(const_cast<HistorySegment*>(history), sizeof(HistorySegment));
+    return 0;
+#endif
+}